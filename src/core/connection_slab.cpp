@@ -0,0 +1,31 @@
+#include "connection_slab.h"
+#include <sys/resource.h>
+
+#include <algorithm>
+
+ConnectionSlab::ConnectionSlab(size_t capacity)
+    : slots_(new Slot[capacity]), capacity_(capacity) {
+}
+
+size_t ConnectionSlab::defaultCapacity(size_t limit) {
+    struct rlimit rlim;
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur != RLIM_INFINITY) {
+        return std::min(static_cast<size_t>(rlim.rlim_cur), limit);
+    }
+    return limit;
+}
+
+HTTPconnection* ConnectionSlab::acquire(int fd) {
+    assert(contains(fd));
+    Slot& slot = slots_[fd];
+    if (!slot.conn) {
+        slot.conn = std::make_unique<HTTPconnection>();
+    }
+    slot.generation.fetch_add(1, std::memory_order_acq_rel);
+    return slot.conn.get();
+}
+
+void ConnectionSlab::release(int fd) {
+    assert(contains(fd));
+    slots_[fd].generation.fetch_add(1, std::memory_order_acq_rel);
+}
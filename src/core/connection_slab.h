@@ -0,0 +1,69 @@
+#ifndef CONNECTION_SLAB_H
+#define CONNECTION_SLAB_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "http_connection.h"
+
+// 以fd为下标的连接表：槽位预分配，连接对象首次使用时创建并一直复用，地址稳定
+// 每个槽位带代数（generation），acquire/release时递增，用于识别已关闭连接的迟到事件
+class ConnectionSlab {
+public:
+    explicit ConnectionSlab(size_t capacity);
+    ~ConnectionSlab() = default;
+
+    ConnectionSlab(const ConnectionSlab&) = delete;
+    ConnectionSlab& operator=(const ConnectionSlab&) = delete;
+
+    // 容量取RLIMIT_NOFILE与上限中的较小值
+    static size_t defaultCapacity(size_t limit);
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    bool contains(int fd) const {
+        return fd >= 0 && static_cast<size_t>(fd) < capacity_;
+    }
+
+    HTTPconnection* acquire(int fd);
+    void release(int fd);
+
+    // 代数一致时返回连接，否则返回nullptr（事件已过期）
+    HTTPconnection* get(int fd, uint32_t generation) const {
+        if (!contains(fd)) {
+            return nullptr;
+        }
+        const Slot& slot = slots_[fd];
+        if (slot.generation.load(std::memory_order_acquire) != generation) {
+            return nullptr;
+        }
+        return slot.conn.get();
+    }
+
+    // 不校验代数，供定时器等持有fd的内部组件使用
+    HTTPconnection* at(int fd) const {
+        assert(contains(fd));
+        return slots_[fd].conn.get();
+    }
+
+    uint32_t generation(int fd) const {
+        assert(contains(fd));
+        return slots_[fd].generation.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Slot {
+        std::unique_ptr<HTTPconnection> conn;
+        std::atomic<uint32_t> generation{0};
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t capacity_;
+};
+
+#endif  // CONNECTION_SLAB_H
@@ -1,6 +1,6 @@
 #include "epoller.h"
 
-Epoller::Epoller(int maxEvent) : epollerFd_(epoll_create(512)), events_(maxEvent) {
+Epoller::Epoller(int maxEvent) : epollerFd_(epoll_create1(EPOLL_CLOEXEC)), events_(maxEvent) {
     assert(epollerFd_ >= 0 && events_.size() > 0);
 }
 
@@ -8,20 +8,40 @@ Epoller::~Epoller() {
     close(epollerFd_);
 }
 
-bool Epoller::addFd(int fd, uint32_t events) {
+bool Epoller::addFd(int fd, uint32_t events, uint32_t tag) {
     if (fd < 0)
         return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
     ev.events = events;
     return 0 == epoll_ctl(epollerFd_, EPOLL_CTL_ADD, fd, &ev);
 }
 
-bool Epoller::modFd(int fd, uint32_t events) {
+bool Epoller::addFdFor(int fd, int owner, uint8_t kind, uint32_t events, uint32_t tag) {
     if (fd < 0)
         return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = (static_cast<uint64_t>(tag) << 32) | (static_cast<uint32_t>(kind) << 24) |
+                  static_cast<uint32_t>(owner);
+    ev.events = events;
+    return 0 == epoll_ctl(epollerFd_, EPOLL_CTL_ADD, fd, &ev);
+}
+
+bool Epoller::modFd(int fd, uint32_t events, uint32_t tag) {
+    if (fd < 0)
+        return false;
+    epoll_event ev = {0};
+    ev.data.u64 = (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
+    ev.events = events;
+    return 0 == epoll_ctl(epollerFd_, EPOLL_CTL_MOD, fd, &ev);
+}
+
+bool Epoller::modFdFor(int fd, int owner, uint8_t kind, uint32_t events, uint32_t tag) {
+    if (fd < 0)
+        return false;
+    epoll_event ev = {0};
+    ev.data.u64 = (static_cast<uint64_t>(tag) << 32) | (static_cast<uint32_t>(kind) << 24) |
+                  static_cast<uint32_t>(owner);
     ev.events = events;
     return 0 == epoll_ctl(epollerFd_, EPOLL_CTL_MOD, fd, &ev);
 }
@@ -44,7 +64,17 @@ int Epoller::wait(int timeoutMs) {
 
 int Epoller::getEventFd(size_t i) const {
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return static_cast<int>(events_[i].data.u64 & 0xffffff);
+}
+
+uint32_t Epoller::getEventTag(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return static_cast<uint32_t>(events_[i].data.u64 >> 32);
+}
+
+uint8_t Epoller::getEventKind(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return static_cast<uint8_t>(events_[i].data.u64 >> 24);
 }
 
 uint32_t Epoller::getEvents(size_t i) const {
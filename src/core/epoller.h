@@ -14,12 +14,18 @@ public:
     explicit Epoller(int maxEvent = 1024);
     ~Epoller();
 
-    bool addFd(int fd, uint32_t events);
-    bool modFd(int fd, uint32_t events);
+    // epoll_event.data.u64 = fd(低24位) | kind(24~31位) | tag(高32位)，tag用于连接代数校验
+    bool addFd(int fd, uint32_t events, uint32_t tag = 0);
+    // 把fd的事件记在另一个fd（owner）名下，kind非0，用于CGI子进程的管道等附属于连接的fd
+    bool addFdFor(int fd, int owner, uint8_t kind, uint32_t events, uint32_t tag);
+    bool modFd(int fd, uint32_t events, uint32_t tag = 0);
+    bool modFdFor(int fd, int owner, uint8_t kind, uint32_t events, uint32_t tag);
     bool delFd(int fd);
     int wait(int timewait = -1);
 
     int getEventFd(size_t i) const;
+    uint32_t getEventTag(size_t i) const;
+    uint8_t getEventKind(size_t i) const;
     uint32_t getEvents(size_t i) const;
 
 private:
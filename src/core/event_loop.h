@@ -0,0 +1,14 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+// 事件循环接口：epoll（Reactor）与io_uring（UringReactor）两种后端共用
+class EventLoop {
+public:
+    virtual ~EventLoop() = default;
+
+    virtual bool isValid() const = 0;
+    virtual void loop() = 0;
+    virtual void stop() = 0;
+};
+
+#endif  // EVENT_LOOP_H
@@ -0,0 +1,358 @@
+#include "reactor.h"
+#include <iostream>
+
+Reactor::Reactor(int listenFd, uint32_t listenEvent, uint32_t connectionEvent,
+                 int timeoutMS, ThreadPool* threadpool):
+    listenFd_(listenFd),
+    timeoutMS_(timeoutMS),
+    isValid_(false),
+    isClose_(false),
+    listenEvent_(listenEvent),
+    connectionEvent_(connectionEvent),
+    threadpool_(threadpool),
+    users_(ConnectionSlab::defaultCapacity(MAX_FD))
+{
+    timer_ = std::make_unique<TimerManager>([this](int fd) {
+        closeConn_(users_.at(fd));
+    });
+    epoller_ = std::make_unique<Epoller>();
+
+    isValid_ = epoller_->addFd(listenFd_, listenEvent_ | EPOLLIN);
+    if(!isValid_) {
+        std::cout<<"Add listen fd to epoll error!"<<std::endl;
+    }
+}
+
+Reactor::~Reactor() {
+    if(listenFd_ != -1) {
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+}
+
+bool Reactor::isValid() const {
+    return isValid_;
+}
+
+void Reactor::stop() {
+    isClose_.store(true, std::memory_order_release);
+}
+
+void Reactor::loop()
+{
+    int timeMS=-1;
+    while(!isClose_.load(std::memory_order_acquire))
+    {
+        if(timeoutMS_>0)
+        {
+            timeMS=timer_->getNextHandle();
+        }
+        int eventCnt=epoller_->wait(timeMS);
+        for(int i=0;i<eventCnt;++i)
+        {
+            int fd=epoller_->getEventFd(i);
+            uint32_t events=epoller_->getEvents(i);
+
+            if(fd==listenFd_)
+            {
+                handleListen_();
+                continue;
+            }
+            // 代数不一致说明连接已在本轮中关闭（fd可能已被新连接复用），丢弃该事件
+            HTTPconnection* client = users_.get(fd, epoller_->getEventTag(i));
+            if(!client) {
+                continue;
+            }
+            if(uint8_t kind = epoller_->getEventKind(i)) {
+                onCgi_(client, static_cast<CgiProcess::Channel>(kind - 1));
+                continue;
+            }
+            if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                closeConn_(client);
+            }
+            else if(!threadpool_) {
+                // run-to-completion模式下EPOLLIN|EPOLLOUT常驻注册，同一事件可能同时可读可写
+                if(events & EPOLLIN) {
+                    handleRead_(client);
+                }
+                if((events & EPOLLOUT) && !client->isClosed() && client->writeBytes() > 0) {
+                    handleWrite_(client);
+                }
+            }
+            else if(events & EPOLLIN) {
+                handleRead_(client);
+            }
+            else if(events & EPOLLOUT) {
+                handleWrite_(client);
+            }
+            else {
+                std::cout<<"Unexpected event"<<std::endl;
+            }
+        }
+    }
+}
+
+void Reactor::sendError_(int fd, const char* info)
+{
+    assert(fd>0);
+    int ret=send(fd,info,strlen(info),0);
+    if(ret<0)
+    {
+        std::cout<<"send error to client"<<fd<<" error!"<<std::endl;
+    }
+    close(fd);
+}
+
+void Reactor::closeConn_(HTTPconnection* client) {
+    assert(client);
+    if(client->isClosed()) {
+        return;
+    }
+    if(!threadpool_) {
+        // 线程池模式下可能在worker线程关闭，定时器只在循环线程操作，由到期回调时忽略已关闭连接
+        timer_->cancel(client->timerNode());
+    }
+    epoller_->delFd(client->getFd());
+    users_.release(client->getFd());
+    client->closeHTTPConn();
+}
+
+void Reactor::addClientConnection(int fd, sockaddr_in addr)
+{
+    assert(fd>0);
+
+    // 检查连接数限制
+    if(HTTPconnection::userCount >= MAX_FD - 100 || !users_.contains(fd)) { // 留一些余量
+        sendError_(fd, "Server busy!");
+        std::cout<<"Too many connections!"<<std::endl;
+        return;
+    }
+
+    HTTPconnection* client = users_.acquire(fd);
+    client->initHTTPConn(fd,addr);
+    if(timeoutMS_>0)
+    {
+        timer_->addTimer(client->timerNode(),fd,timeoutMS_);
+    }
+    // run-to-completion模式一次性注册读写事件，之后不再需要epoll_ctl
+    epoller_->addFd(fd,EPOLLIN | connectionEvent_ | (threadpool_ ? 0 : EPOLLOUT), users_.generation(fd));
+}
+
+void Reactor::handleListen_() {
+    struct sockaddr_in addr;
+    do {
+        socklen_t len = sizeof(addr);  // 每次循环重置len
+        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd <= 0) { return;}
+        else if(HTTPconnection::userCount >= MAX_FD) {
+            sendError_(fd, "Server busy!");
+            std::cout<<"Clients is full!"<<std::endl;
+            return;
+        }
+        addClientConnection(fd, addr);
+    } while(listenEvent_ & EPOLLET);
+}
+
+void Reactor::handleRead_(HTTPconnection* client) {
+    assert(client);
+    extentTime_(client);
+    if(!threadpool_) {
+        onRead_(client);
+        return;
+    }
+    // 不需要返回值，走无分配的post路径
+    threadpool_->post([this, conn = client]() {
+        this->onRead_(conn);
+    });
+}
+
+void Reactor::handleWrite_(HTTPconnection* client)
+{
+    assert(client);
+    extentTime_(client);
+    if(CgiProcess* cgi = client->startedCgi()) {
+        watchCgi_(client, cgi);  // worker刚启动的子进程，由循环线程登记
+        return;
+    }
+    // 转发CGI输出期间子进程的事件在循环线程处理，连接的写也留在循环线程，避免与worker同时访问输出
+    if(!threadpool_ || client->cgi()) {
+        onWrite_(client);
+        return;
+    }
+    // 不需要返回值，走无分配的post路径
+    threadpool_->post([this, conn = client]() {
+        this->onWrite_(conn);
+    });
+}
+
+void Reactor::extentTime_(HTTPconnection* client)
+{
+    assert(client);
+    if(timeoutMS_>0)
+    {
+        timer_->update(client->timerNode(),timeoutMS_);
+    }
+}
+
+void Reactor::onRead_(HTTPconnection* client)
+{
+    assert(client);
+    int ret = -1;
+    int readErrno = 0;
+    ret = client->readBuffer(&readErrno);
+    if(ret <= 0 && readErrno != EAGAIN) {
+        closeConn_(client);
+        return;
+    }
+    onProcess_(client);
+    // ET模式下单次readBuffer有读取上限，没有读到EAGAIN时套接字里可能还有数据（如大请求体）
+    // run-to-completion模式不会重新注册事件，需要自己继续读，否则等不到下一次边沿
+    while(!threadpool_ && HTTPconnection::isET && readErrno != EAGAIN && !client->isClosed()) {
+        ret = client->readBuffer(&readErrno);
+        if(ret <= 0 && readErrno != EAGAIN) {
+            closeConn_(client);
+            return;
+        }
+        onProcess_(client);
+    }
+}
+
+void Reactor::onProcess_(HTTPconnection* client)
+{
+    if(!threadpool_) {
+        // 处理完立即写回，写完且keep-alive时继续处理缓冲区中剩余的请求
+        while(client->handleHTTPConn()) {
+            resumeCgiOutput_(client);
+            if(!flush_(client)) {
+                return;
+            }
+        }
+        if(CgiProcess* cgi = client->startedCgi()) {
+            watchCgi_(client, cgi);
+        }
+        return;
+    }
+    const int fd = client->getFd();
+    if(client->handleHTTPConn()) {
+        resumeCgiOutput_(client);
+        epoller_->modFd(fd, connectionEvent_ | EPOLLOUT, users_.generation(fd));
+    }
+    else if(client->hasStartedCgi()) {
+        // 子进程的fd交给循环线程登记：连接以EPOLLOUT重新注册（写缓冲区为空，几乎立即可写），
+        // worker此后不再访问连接，由循环线程在handleWrite_中登记；转发输出期间连接不登记事件，由onCgi_继续
+        epoller_->modFd(fd, connectionEvent_ | EPOLLOUT, users_.generation(fd));
+    }
+    else if(!client->cgi()) {
+        epoller_->modFd(fd, connectionEvent_ | EPOLLIN, users_.generation(fd));
+    }
+}
+
+void Reactor::watchCgi_(HTTPconnection* client, CgiProcess* cgi)
+{
+    // 总在事件循环线程调用：登记期间子进程的事件、写出错和超时都不会并发地关闭连接、释放子进程
+    const int fd = client->getFd();
+    const uint32_t gen = users_.generation(fd);
+    const CgiProcess::Channel channels[] = { CgiProcess::STDIN, CgiProcess::STDOUT, CgiProcess::EXIT };
+    for(CgiProcess::Channel channel : channels) {
+        if(cgi->fd(channel) < 0) {
+            continue;  // 请求体已经写完，或者不支持pidfd；FastCGI请求只有stdout通道
+        }
+        if(channel == CgiProcess::STDOUT) {
+            armCgiOutput_(client, cgi);
+            continue;
+        }
+        epoller_->addFdFor(cgi->fd(channel), fd, channel + 1, cgiEvents_(cgi, channel), gen);
+    }
+}
+
+uint32_t Reactor::cgiEvents_(CgiProcess* cgi, CgiProcess::Channel channel)
+{
+    // stdout一次性登记，缓冲的输出达到上限时不再重新登记；其余通道以ET方式常驻
+    // FastCGI连接在请求记录发完之前同时等待可写
+    if(channel == CgiProcess::STDOUT) {
+        return EPOLLIN | (cgi->sending() ? EPOLLOUT : 0) | EPOLLONESHOT;
+    }
+    return (channel == CgiProcess::STDIN ? EPOLLOUT : EPOLLIN) | EPOLLET;
+}
+
+void Reactor::armCgiOutput_(HTTPconnection* client, CgiProcess* cgi)
+{
+    // 池中取出的FastCGI连接可能仍留在epoll中（上次的一次性登记已失效），重连后则是还没登记的新fd
+    const int fd = client->getFd();
+    const int out = cgi->fd(CgiProcess::STDOUT);
+    const uint32_t events = cgiEvents_(cgi, CgiProcess::STDOUT);
+    if(!epoller_->modFdFor(out, fd, CgiProcess::STDOUT + 1, events, users_.generation(fd))) {
+        epoller_->addFdFor(out, fd, CgiProcess::STDOUT + 1, events, users_.generation(fd));
+    }
+}
+
+void Reactor::resumeCgiOutput_(HTTPconnection* client)
+{
+    // 暂停期间缓冲的输出刚被取走，重新等待stdout
+    CgiProcess* cgi = client->cgi();
+    if(cgi && cgi->resumeOutput()) {
+        armCgiOutput_(client, cgi);
+    }
+}
+
+void Reactor::onCgi_(HTTPconnection* client, CgiProcess::Channel channel)
+{
+    CgiProcess* cgi = client->cgi();
+    if(!cgi || cgi->finished()) {
+        return;
+    }
+    // 通道结束时关闭对应fd，同时从epoll中移除
+    cgi->onReady(channel);
+    extentTime_(client);
+    if(channel == CgiProcess::STDOUT && cgi->fd(channel) >= 0 && !cgi->outputPaused()) {
+        armCgiOutput_(client, cgi);
+    }
+    // 有新的输出或子进程已结束：上一批已写完时立即转发，否则由写回调在写完后继续
+    // 线程池模式下也直接在循环线程处理，子进程结束前连接的写事件同样留在循环线程
+    if(client->writeBytes() == 0) {
+        onProcess_(client);
+    }
+}
+
+void Reactor::onWrite_(HTTPconnection* client) {
+    assert(client);
+    if(!threadpool_) {
+        if(flush_(client)) {
+            onProcess_(client);
+        }
+        return;
+    }
+    int ret = -1;
+    int writeErrno = 0;
+    ret = client->writeBuffer(&writeErrno);
+    if (client->writeBytes() == 0) {
+        if (client->isKeepAlive()) {
+            onProcess_(client);
+            return;
+        }
+    } else if (ret > 0 || writeErrno == EAGAIN) {
+        // 写满EAGAIN或达到单次写上限（大文件）时都还有剩余，重新等待可写事件，不占用worker
+        epoller_->modFd(client->getFd(), connectionEvent_ | EPOLLOUT, users_.generation(client->getFd()));
+        return;
+    }
+    closeConn_(client);
+}
+
+bool Reactor::flush_(HTTPconnection* client) {
+    // 单线程模式没有其他连接在排队等待worker，直接写到EAGAIN或写完为止
+    int writeErrno = 0;
+    ssize_t ret = -1;
+    do {
+        ret = client->writeBuffer(&writeErrno);
+    } while(ret > 0 && client->writeBytes() > 0);
+
+    if(client->writeBytes() == 0) {
+        if(client->isKeepAlive()) {
+            return true;
+        }
+    } else if(ret < 0 && writeErrno == EAGAIN) {
+        return false;  // EPOLLOUT以ET方式常驻注册，等待下一次可写边沿
+    }
+    closeConn_(client);
+    return false;
+}
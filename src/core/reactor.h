@@ -0,0 +1,70 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <memory>
+
+#include "connection_slab.h"
+#include "epoller.h"
+#include "event_loop.h"
+#include "http_connection.h"
+#include "threadpool.h"
+#include "timer.h"
+
+// 单个事件循环：拥有独立的Epoller、监听socket、定时器和连接表
+// threadpool为nullptr时以run-to-completion方式在本线程内完成读、处理、写
+class Reactor : public EventLoop {
+public:
+    Reactor(int listenFd, uint32_t listenEvent, uint32_t connectionEvent,
+            int timeoutMS, ThreadPool* threadpool = nullptr);
+    ~Reactor() override;
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    bool isValid() const override;
+    void loop() override;
+    void stop() override;
+
+    static const int MAX_FD = 65536;  // 不超过epoll data中fd的24位
+
+private:
+    void addClientConnection(int fd, sockaddr_in addr);  //添加一个HTTP连接
+    void closeConn_(HTTPconnection* client);             //关闭一个HTTP连接
+
+    void handleListen_();
+    void handleWrite_(HTTPconnection* client);
+    void handleRead_(HTTPconnection* client);
+
+    void onRead_(HTTPconnection* client);
+    void onWrite_(HTTPconnection* client);
+    void onProcess_(HTTPconnection* client);
+    bool flush_(HTTPconnection* client);  // run-to-completion模式下的同步写回
+    // CGI子进程的管道和pidfd登记在所属连接名下，事件总是在循环线程处理（非阻塞读写很短）
+    void watchCgi_(HTTPconnection* client, CgiProcess* cgi);
+    void onCgi_(HTTPconnection* client, CgiProcess::Channel channel);
+    uint32_t cgiEvents_(CgiProcess* cgi, CgiProcess::Channel channel);
+    void armCgiOutput_(HTTPconnection* client, CgiProcess* cgi);
+    void resumeCgiOutput_(HTTPconnection* client);
+
+    void sendError_(int fd, const char* info);
+    void extentTime_(HTTPconnection* client);
+
+    int listenFd_;
+    int timeoutMS_;
+    bool isValid_;
+    std::atomic<bool> isClose_;
+
+    uint32_t listenEvent_;
+    uint32_t connectionEvent_;
+
+    ThreadPool* threadpool_;  // 不拥有，为空表示单线程模式
+    std::unique_ptr<TimerManager> timer_;
+    std::unique_ptr<Epoller> epoller_;
+    ConnectionSlab users_;
+};
+
+#endif  // REACTOR_H
@@ -6,10 +6,19 @@
 #include <vector>
 #include <functional>
 #include <future>
+#include <stdexcept>
 #include <memory>
 #include <chrono>
+#include <climits>
+#include <cstddef>
+#include <new>
+#include <cstring>
+#include <type_traits>
 #include <pthread.h>
 #include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 // CPU绑核工具函数
 inline void bindToCore(size_t coreId) {
@@ -19,6 +28,61 @@ inline void bindToCore(size_t coreId) {
     pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
 }
 
+// 自旋等待时的CPU提示，降低功耗并让出超线程资源
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// 空闲worker的停车位：futex等待epoch变化
+// sleepers_记录休眠者数量，生产者只在有人休眠时才递增epoch并发起唤醒系统调用
+class Parker {
+public:
+    // 休眠前登记，返回当前epoch；登记后调用方必须再检查一次队列
+    uint32_t prepare() noexcept {
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return epoch_.load(std::memory_order_seq_cst);
+    }
+
+    // epoch未变化时休眠，被唤醒或epoch已变化时返回
+    void wait(uint32_t epoch) noexcept {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE,
+                epoch, nullptr, nullptr, 0);
+    }
+
+    void cancel() noexcept {
+        sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    // 生产者入队后调用：无休眠者时只有一次load
+    void notifyOne() noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+            epoch_.fetch_add(1, std::memory_order_seq_cst);
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE,
+                    1, nullptr, nullptr, 0);
+        }
+    }
+
+    void notifyAll() noexcept {
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE,
+                INT_MAX, nullptr, nullptr, 0);
+    }
+
+private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32-bit");
+
+    alignas(64) std::atomic<uint32_t> epoch_{0};
+    alignas(64) std::atomic<int> sleepers_{0};
+};
+
 // 受Folly MPMCQueue启发的高性能无锁队列
 template<typename T, size_t Size>
 class MPMCQueue {
@@ -98,45 +162,272 @@ public:
     }
 };
 
+// 定长内联可调用对象：闭包直接存放在队列槽位中，提交时不分配堆内存
+// 只接受可平凡拷贝、可平凡析构的闭包（如捕获若干指针的lambda），因此自身也可按字节拷贝
+class InlineTask {
+public:
+    static constexpr size_t kCapacity = 48;
+
+    InlineTask() noexcept = default;
+
+    template<typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, InlineTask>::value>>
+    InlineTask(F&& f) noexcept {
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= kCapacity, "callable too large for InlineTask");
+        static_assert(alignof(Fn) <= alignof(std::max_align_t), "callable over-aligned");
+        static_assert(std::is_trivially_copyable<Fn>::value && std::is_trivially_destructible<Fn>::value,
+                      "InlineTask requires a trivially copyable callable");
+        ::new (static_cast<void*>(storage_)) Fn(std::forward<F>(f));
+        invoke_ = [](void* p) { (*static_cast<Fn*>(p))(); };
+    }
+
+    void operator()() { invoke_(storage_); }
+    explicit operator bool() const noexcept { return invoke_ != nullptr; }
+
+private:
+    void (*invoke_)(void*) = nullptr;
+    alignas(std::max_align_t) unsigned char storage_[kCapacity];
+};
+
+// Chase-Lev工作窃取双端队列（有界版本）
+// 所有者在bottom端push/pop，其他线程在top端steal
+// 元素按64位字以relaxed原子读写，窃取失败时读到的旧值直接丢弃，因此T必须可平凡拷贝
+template<typename T, size_t Size>
+class WorkStealingDeque {
+    static_assert((Size & (Size - 1)) == 0, "Size must be power of 2");
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    static constexpr int64_t kMask = Size - 1;
+
+    struct Slot {
+        std::atomic<uint64_t> words[kWords];
+    };
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    alignas(64) Slot slots_[Size];
+
+    void store_(int64_t i, const T& item) noexcept {
+        uint64_t words[kWords] = {};
+        std::memcpy(words, &item, sizeof(T));
+        Slot& slot = slots_[i & kMask];
+        for (size_t w = 0; w < kWords; ++w) {
+            slot.words[w].store(words[w], std::memory_order_relaxed);
+        }
+    }
+
+    T load_(int64_t i) const noexcept {
+        uint64_t words[kWords];
+        const Slot& slot = slots_[i & kMask];
+        for (size_t w = 0; w < kWords; ++w) {
+            words[w] = slot.words[w].load(std::memory_order_relaxed);
+        }
+        T item;
+        std::memcpy(&item, words, sizeof(T));
+        return item;
+    }
+
+public:
+    // 仅所有者调用
+    bool push(const T& item) noexcept {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        if (b - t >= static_cast<int64_t>(Size)) {
+            return false;  // 队列满
+        }
+        store_(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 仅所有者调用，LIFO保证缓存局部性
+    bool pop(T& item) noexcept {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;  // 队列空
+        }
+        item = load_(b);
+        if (t == b) {
+            // 最后一个元素，与窃取者竞争
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 任意线程调用，FIFO端
+    bool steal(T& item) noexcept {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+        T candidate = load_(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return false;  // 被其他窃取者或所有者抢先
+        }
+        item = candidate;
+        return true;
+    }
+
+    bool empty() const noexcept {
+        int64_t t = top_.load(std::memory_order_acquire);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        return t >= b;
+    }
+};
+
 class ThreadPool {
 private:
-    using Task = std::function<void()>;
+    using Task = InlineTask;
     static constexpr size_t QUEUE_SIZE = 2048;
+    static constexpr size_t LOCAL_QUEUE_SIZE = 256;
+    // 空闲时先自旋约数十微秒再休眠，负载下的唤醒无需系统调用
+    static constexpr int SPIN_LIMIT = 2048;
+
+    // worker线程提交的任务进入自己的双端队列
+    using LocalQueue = WorkStealingDeque<Task, LOCAL_QUEUE_SIZE>;
     
-    MPMCQueue<Task, QUEUE_SIZE> queue_;
+    MPMCQueue<Task, QUEUE_SIZE> queue_;  // 全局注入队列：非worker线程提交的任务
+    std::vector<std::unique_ptr<LocalQueue>> locals_;
+    Parker parker_;
     std::vector<std::thread> workers_;
     std::atomic<bool> stop_{false};
 
+    // 当前线程所属的线程池和worker序号，非worker线程为nullptr
+    static inline thread_local ThreadPool* currentPool_ = nullptr;
+    static inline thread_local size_t currentIndex_ = 0;
+
+    bool hasWork_() const noexcept {
+        if (!queue_.empty()) {
+            return true;
+        }
+        for (const auto& local : locals_) {
+            if (!local->empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 从其他worker的队列头部窃取，起点随机以分散竞争
+    bool steal_(size_t self, uint32_t& seed, Task& task) noexcept {
+        const size_t n = locals_.size();
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        const size_t start = seed % n;
+        for (size_t k = 0; k < n; ++k) {
+            size_t victim = (start + k) % n;
+            if (victim != self && locals_[victim]->steal(task)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop_(size_t index) {
+        currentPool_ = this;
+        currentIndex_ = index;
+        LocalQueue& local = *locals_[index];
+        uint32_t seed = static_cast<uint32_t>(index * 2654435761u + 1);
+
+        Task task;
+        int spins = 0;
+        while (!stop_.load(std::memory_order_acquire)) {
+            // 顺序：本地队列 → 全局注入队列 → 窃取
+            if (local.pop(task)) {
+                task();
+                spins = 0;
+            } else if (queue_.dequeue(task)) {
+                task();
+                spins = 0;
+            } else if (steal_(index, seed, task)) {
+                task();
+                spins = 0;
+            } else if (spins < SPIN_LIMIT) {
+                ++spins;
+                cpuRelax();
+            } else {
+                // 登记后再检查一次，避免与生产者的入队交错导致丢失唤醒
+                uint32_t epoch = parker_.prepare();
+                if (!hasWork_() && !stop_.load(std::memory_order_acquire)) {
+                    parker_.wait(epoch);
+                }
+                parker_.cancel();
+                spins = 0;
+            }
+        }
+        
+        // 处理剩余任务
+        while (local.pop(task)) {
+            task();
+        }
+        while (queue_.dequeue(task)) {
+            task();
+        }
+    }
+
+    // 提交到全局注入队列，队列持续满时在当前线程直接执行
+    void inject_(Task task) {
+        // 尝试多次提交，受Folly启发的重试策略
+        for (int retries = 0; retries < 100; ++retries) {
+            if (queue_.enqueue(task)) {
+                parker_.notifyOne();
+                return;
+            }
+            
+            if (retries < 10) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(1));
+            }
+        }
+        
+        task();
+    }
+
+    void schedule_(const Task& task) {
+        // 从worker提交：留在本地队列，空闲worker可以窃取；本地队列满时转入全局队列
+        if (currentPool_ == this && locals_[currentIndex_]->push(task)) {
+            parker_.notifyOne();
+            return;
+        }
+        inject_(task);
+    }
+
 public:
     explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
         if (threads == 0) threads = 1;
         
         const size_t cpuCnt = std::thread::hardware_concurrency();
+        locals_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            locals_.push_back(std::make_unique<LocalQueue>());
+        }
         workers_.reserve(threads);
         for (size_t i = 0; i < threads; ++i) {
             workers_.emplace_back([this, i, cpuCnt] {
                 // 绑核：worker_i → core_(i % cpuCnt)
                 bindToCore(i % cpuCnt);
-                
-                Task task;
-                while (!stop_.load(std::memory_order_acquire)) {
-                    if (queue_.dequeue(task)) {
-                        task();
-                    } else {
-                        std::this_thread::yield();
-                    }
-                }
-                
-                // 处理剩余任务
-                while (queue_.dequeue(task)) {
-                    task();
-                }
+                workerLoop_(i);
             });
         }
     }
 
     ~ThreadPool() {
         stop_.store(true, std::memory_order_release);
+        parker_.notifyAll();
         
         for (auto& worker : workers_) {
             if (worker.joinable()) {
@@ -158,29 +449,29 @@ public:
             throw std::runtime_error("ThreadPool is stopping");
         }
         
-        auto task = std::make_shared<std::packaged_task<ReturnType()>>(
+        // packaged_task由执行它的worker释放，队列中只保存一个指针
+        auto* task = new std::packaged_task<ReturnType()>(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...)
         );
         
         std::future<ReturnType> future = task->get_future();
-        
-        // 尝试多次提交，受Folly启发的重试策略
-        for (int retries = 0; retries < 100; ++retries) {
-            if (queue_.enqueue([task]() { (*task)(); })) {
-                return future;
-            }
-            
-            if (retries < 10) {
-                std::this_thread::yield();
-            } else {
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
-            }
-        }
-        
-        (*task)();
+        schedule_(Task([task]() {
+            (*task)();
+            delete task;
+        }));
         return future;
     }
 
+    // 无返回值的提交：闭包直接存入队列槽位，不产生任何堆分配
+    // f必须可平凡拷贝且不超过InlineTask::kCapacity，适合捕获若干指针的lambda
+    template<class F>
+    void post(F&& f) {
+        if (stop_.load(std::memory_order_acquire)) {
+            throw std::runtime_error("ThreadPool is stopping");
+        }
+        schedule_(Task(std::forward<F>(f)));
+    }
+
     size_t size() const noexcept {
         return queue_.size();
     }
@@ -190,4 +481,4 @@ public:
     }
 };
 
-#endif // THREADPOOL_H
\ No newline at end of file
+#endif // THREADPOOL_H
@@ -0,0 +1,285 @@
+#include "uring.h"
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#include <algorithm>
+
+Uring::Uring(unsigned entries):
+    ringFd_(-1), features_(0),
+    sqRing_(MAP_FAILED), cqRing_(MAP_FAILED), sqRingSize_(0), cqRingSize_(0),
+    sqHead_(nullptr), sqTail_(nullptr), sqArray_(nullptr), sqMask_(0), sqEntries_(0),
+    sqes_(nullptr), sqesSize_(0), sqeTail_(0), sqeHead_(0),
+    cqHead_(nullptr), cqTail_(nullptr), cqMask_(0), cqes_(nullptr),
+    bufRing_(nullptr), bufRingSize_(0), bufBase_(nullptr), bufBaseSize_(0),
+    bufSize_(0), bufMask_(0), bufTail_(0), bgid_(0), legacyBufs_(false)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 完成事件只在io_uring_enter时处理，不需要IPI打断运行中的线程
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    ringFd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd_ < 0 && errno == EINVAL) {
+        // 旧内核不支持上述flag时退回默认配置
+        memset(&params, 0, sizeof(params));
+        ringFd_ = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (ringFd_ < 0) {
+        return;
+    }
+    features_ = params.features;
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        close(ringFd_);
+        ringFd_ = -1;
+        return;
+    }
+    if (features_ & IORING_FEAT_SINGLE_MMAP) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ringFd_, IORING_OFF_CQ_RING);
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQES);
+    if (cqRing_ == MAP_FAILED || sqes == MAP_FAILED) {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize_);
+        }
+        if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+            munmap(cqRing_, cqRingSize_);
+        }
+        munmap(sqRing_, sqRingSize_);
+        sqRing_ = cqRing_ = MAP_FAILED;
+        close(ringFd_);
+        ringFd_ = -1;
+        return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    // SQ数组与SQE一一对应，初始化一次即可
+    for (unsigned i = 0; i < sqEntries_; ++i) {
+        sqArray_[i] = i;
+    }
+    sqeTail_ = sqeHead_ = *sqTail_;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+Uring::~Uring() {
+    if (bufRing_) {
+        munmap(bufRing_, bufRingSize_);
+    }
+    if (bufBase_) {
+        munmap(bufBase_, bufBaseSize_);
+    }
+    if (sqes_) {
+        munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED) {
+        munmap(sqRing_, sqRingSize_);
+    }
+    if (ringFd_ >= 0) {
+        close(ringFd_);
+    }
+}
+
+bool Uring::isValid() const {
+    return ringFd_ >= 0;
+}
+
+io_uring_sqe* Uring::getSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= sqEntries_) {
+        submit();
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqeTail_ - head >= sqEntries_) {
+            return nullptr;
+        }
+    }
+    io_uring_sqe* sqe = &sqes_[sqeTail_ & sqMask_];
+    ++sqeTail_;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void Uring::flushSq_() {
+    if (sqeHead_ != sqeTail_) {
+        __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    }
+}
+
+int Uring::enter_(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    int ret;
+    // 与Epoller::wait一致，信号中断时重试
+    while ((ret = syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, arg, argSize)) < 0
+           && errno == EINTR) {
+    }
+    return ret;
+}
+
+int Uring::submit() {
+    flushSq_();
+    unsigned toSubmit = sqeTail_ - sqeHead_;
+    if (toSubmit == 0) {
+        return 0;
+    }
+    int ret = enter_(toSubmit, 0, 0, nullptr, 0);
+    if (ret > 0) {
+        sqeHead_ += ret;
+    }
+    return ret;
+}
+
+int Uring::submitAndWait(int timeoutMs) {
+    flushSq_();
+    unsigned toSubmit = sqeTail_ - sqeHead_;
+    // CQ中已有未处理的完成事件时不再阻塞
+    bool ready = *cqHead_ != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    unsigned minComplete = ready ? 0 : 1;
+    unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    if (minComplete && timeoutMs >= 0) {
+        __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        ret = enter_(toSubmit, minComplete, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    } else if (toSubmit || minComplete) {
+        ret = enter_(toSubmit, minComplete, flags, nullptr, _NSIG / 8);
+    } else {
+        return 0;
+    }
+    // 有提交时返回值为提交数量，即使等待超时
+    if (ret > 0) {
+        sqeHead_ += std::min(static_cast<unsigned>(ret), toSubmit);
+    }
+    return ret;
+}
+
+bool Uring::setupBufRing(uint16_t bgid, unsigned entries, unsigned bufSize) {
+    assert((entries & (entries - 1)) == 0 && entries <= 32768);
+    bufBaseSize_ = static_cast<size_t>(entries) * bufSize;
+    void* base = mmap(nullptr, bufBaseSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    bufBase_ = static_cast<char*>(base);
+    bufSize_ = bufSize;
+    bufMask_ = entries - 1;
+    bufTail_ = 0;
+    bgid_ = bgid;
+
+    bufRingSize_ = entries * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring != MAP_FAILED) {
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+        reg.ring_entries = entries;
+        reg.bgid = bgid;
+        if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) == 0) {
+            bufRing_ = static_cast<io_uring_buf_ring*>(ring);
+            for (unsigned i = 0; i < entries; ++i) {
+                recycleBuf(static_cast<uint16_t>(i));
+            }
+            if (probeBufRing_()) {
+                return true;
+            }
+            // 部分内核/沙箱注册成功但选不到缓冲区，注销后改用旧接口
+            syscall(__NR_io_uring_register, ringFd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            bufRing_ = nullptr;
+        }
+        munmap(ring, bufRingSize_);
+    }
+
+    legacyBufs_ = true;
+    provideBufs_(0, entries);
+    return submit() >= 0;
+}
+
+bool Uring::probeBufRing_() {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        return false;
+    }
+    bool ok = false;
+    io_uring_sqe* sqe = getSqe();
+    if (sqe && write(sv[1], "p", 1) == 1) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = bgid_;
+        sqe->user_data = 0;
+        if (submitAndWait(1000) >= 0) {
+            forEachCqe([this, &ok](const io_uring_cqe* cqe) {
+                if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                    ok = true;
+                    recycleBuf(static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+                }
+            });
+        }
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return ok;
+}
+
+void Uring::provideBufs_(uint16_t bid, unsigned count) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(bufAddr(bid));
+    sqe->len = bufSize_;
+    sqe->off = bid;
+    sqe->buf_group = bgid_;
+    sqe->user_data = 0;
+}
+
+char* Uring::bufAddr(uint16_t bid) const {
+    return bufBase_ + static_cast<size_t>(bid) * bufSize_;
+}
+
+void Uring::recycleBuf(uint16_t bid) {
+    if (legacyBufs_) {
+        // 旧接口：随下一次io_uring_enter一起提交，不额外产生系统调用
+        provideBufs_(bid, 1);
+        return;
+    }
+    io_uring_buf* buf = &bufRing_->bufs[bufTail_ & bufMask_];
+    buf->addr = reinterpret_cast<uint64_t>(bufAddr(bid));
+    buf->len = bufSize_;
+    buf->bid = bid;
+    ++bufTail_;
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,87 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// io_uring的最小封装（直接使用系统调用，不依赖liburing）
+// 只在所属线程内使用：提交队列和完成队列都不是线程安全的
+class Uring {
+public:
+    explicit Uring(unsigned entries = 4096);
+    ~Uring();
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    bool isValid() const;
+
+    // 取一个空闲SQE（已清零），SQ满时先提交一次
+    io_uring_sqe* getSqe();
+    // 提交所有待提交的SQE；timeoutMs>=0时最多等待timeoutMs，<0时阻塞到至少一个完成事件
+    int submitAndWait(int timeoutMs);
+    int submit();
+
+    // 遍历所有已完成的CQE，处理完后统一推进CQ头
+    template<typename F>
+    unsigned forEachCqe(F&& f) {
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        unsigned cnt = 0;
+        for (; head != tail; ++head, ++cnt) {
+            f(&cqes_[head & cqMask_]);
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        return cnt;
+    }
+
+    // provided buffer ring：内核为recv自动挑选缓冲区
+    // 注册后先用socketpair探测一次，不可用时退回IORING_OP_PROVIDE_BUFFERS（归还时user_data为0）
+    bool setupBufRing(uint16_t bgid, unsigned entries, unsigned bufSize);
+    char* bufAddr(uint16_t bid) const;
+    void recycleBuf(uint16_t bid);
+
+private:
+    void flushSq_();
+    bool probeBufRing_();
+    void provideBufs_(uint16_t bid, unsigned count);
+    int enter_(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize);
+
+    int ringFd_;
+    unsigned features_;
+
+    void* sqRing_;
+    void* cqRing_;
+    size_t sqRingSize_;
+    size_t cqRingSize_;
+
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqArray_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    unsigned sqeTail_;    // 本地已填写的SQE尾部
+    unsigned sqeHead_;    // 本地已提交给内核的位置
+
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+
+    io_uring_buf_ring* bufRing_;
+    size_t bufRingSize_;
+    char* bufBase_;
+    size_t bufBaseSize_;
+    unsigned bufSize_;
+    unsigned bufMask_;
+    uint16_t bufTail_;
+    uint16_t bgid_;
+    bool legacyBufs_;  // true表示使用IORING_OP_PROVIDE_BUFFERS
+};
+
+#endif  // URING_H
@@ -0,0 +1,312 @@
+#include "uring_reactor.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <iostream>
+
+UringReactor::UringReactor(int listenFd, int timeoutMS):
+    listenFd_(listenFd),
+    timeoutMS_(timeoutMS),
+    isValid_(false),
+    isClose_(false),
+    users_(ConnectionSlab::defaultCapacity(MAX_FD))
+{
+    ring_ = std::make_unique<Uring>();
+    timer_ = std::make_unique<TimerManager>([this](int fd) {
+        closeConn_(users_.at(fd));
+    });
+    if(!ring_->isValid()) {
+        std::cout<<"io_uring setup error!"<<std::endl;
+        return;
+    }
+    if(!ring_->setupBufRing(BUF_GROUP, BUF_COUNT, BUF_SIZE)) {
+        std::cout<<"io_uring provided buffer ring error!"<<std::endl;
+        return;
+    }
+    isValid_ = true;
+}
+
+UringReactor::~UringReactor() {
+    if(listenFd_ != -1) {
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+}
+
+bool UringReactor::isValid() const {
+    return isValid_;
+}
+
+void UringReactor::stop() {
+    isClose_.store(true, std::memory_order_release);
+}
+
+uint64_t UringReactor::makeData_(Op op, int fd, uint32_t gen) {
+    return (static_cast<uint64_t>(op) << 56) |
+           (static_cast<uint64_t>(fd & 0xffffff) << 32) |
+           gen;
+}
+
+void UringReactor::loop()
+{
+    armAccept_();
+    int timeMS=-1;
+    while(!isClose_.load(std::memory_order_acquire))
+    {
+        if(timeoutMS_>0)
+        {
+            timeMS=timer_->getNextHandle();
+        }
+        // 一次系统调用同时完成提交和等待
+        ring_->submitAndWait(timeMS);
+        ring_->forEachCqe([this](const io_uring_cqe* cqe) {
+            handleCqe_(cqe);
+        });
+    }
+}
+
+void UringReactor::handleCqe_(const io_uring_cqe* cqe)
+{
+    const Op op = static_cast<Op>(cqe->user_data >> 56);
+    const int fd = static_cast<int>((cqe->user_data >> 32) & 0xffffff);
+    const uint32_t gen = static_cast<uint32_t>(cqe->user_data);
+
+    if(op == OP_ACCEPT) {
+        handleAccept_(cqe);
+        return;
+    }
+    if(op == OP_CANCEL || cqe->user_data == 0) {
+        return;  // 取消请求和归还缓冲区的完成事件无需处理
+    }
+    if(op == OP_WRITE && !pendingWrites_.empty() && pendingWrites_.erase(cqe->user_data)) {
+        return;  // 连接关闭时在途的writev结束，内核不再读取它的写缓冲区和文件映射
+    }
+
+    // 连接已关闭（或fd已被新连接复用）时的迟到事件：只归还缓冲区
+    HTTPconnection* client = users_.get(fd, gen);
+    if(!client || client->isClosed()) {
+        if(op == OP_RECV && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            ring_->recycleBuf(static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return;
+    }
+
+    if(op == OP_RECV) {
+        handleRecv_(client, cqe);
+    } else if(op == OP_WRITE) {
+        handleWrite_(client, cqe);
+    } else if(op >= OP_CGI && op < OP_CGI + CgiProcess::CHANNEL_COUNT) {
+        onCgi_(client, static_cast<CgiProcess::Channel>(op - OP_CGI));
+    } else {
+        std::cout<<"Unexpected completion"<<std::endl;
+    }
+}
+
+void UringReactor::armAccept_() {
+    io_uring_sqe* sqe = ring_->getSqe();
+    if(!sqe) {
+        return;
+    }
+    // multishot accept：一次提交持续产生新连接，不需要对端地址
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = makeData_(OP_ACCEPT, listenFd_, 0);
+}
+
+void UringReactor::armRecv_(HTTPconnection* client) {
+    io_uring_sqe* sqe = ring_->getSqe();
+    if(!sqe) {
+        closeConn_(client);  // getSqe已提交过仍没有空位，不关闭的话连接再也收不到数据
+        return;
+    }
+    const int fd = client->getFd();
+    // multishot recv + provided buffer：每次到达的数据由内核挑选缓冲区
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = makeData_(OP_RECV, fd, users_.generation(fd));
+}
+
+void UringReactor::armWrite_(HTTPconnection* client) {
+    io_uring_sqe* sqe = ring_->getSqe();
+    if(!sqe) {
+        closeConn_(client, false);
+        return;
+    }
+    int cnt = 0;
+    const struct iovec* iov = client->writeIov(&cnt);
+    // 响应头与文件内容合并为一次writev，iovec由连接持有直到完成
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = client->getFd();
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = cnt;
+    sqe->user_data = makeData_(OP_WRITE, client->getFd(), users_.generation(client->getFd()));
+}
+
+void UringReactor::handleAccept_(const io_uring_cqe* cqe) {
+    if(!(cqe->flags & IORING_CQE_F_MORE)) {
+        armAccept_();
+    }
+    if(cqe->res < 0) {
+        return;
+    }
+    addClientConnection(cqe->res);
+}
+
+void UringReactor::addClientConnection(int fd)
+{
+    assert(fd>0);
+    if(!users_.contains(fd) || HTTPconnection::userCount >= MAX_FD - 100) {
+        send(fd, "Server busy!", 12, MSG_DONTWAIT);
+        close(fd);
+        std::cout<<"Too many connections!"<<std::endl;
+        return;
+    }
+
+    sockaddr_in addr = {0};
+    HTTPconnection* client = users_.acquire(fd);
+    client->initHTTPConn(fd,addr);
+    if(timeoutMS_>0)
+    {
+        timer_->addTimer(client->timerNode(),fd,timeoutMS_);
+    }
+    armRecv_(client);
+}
+
+void UringReactor::closeConn_(HTTPconnection* client, bool writing) {
+    assert(client);
+    if(client->isClosed()) {
+        return;
+    }
+    const int fd = client->getFd();
+    if(writing && client->writeBytes() > 0) {
+        // 取消的writev可能已经在内核中读取数据，写缓冲区和文件映射保留到它的完成事件到达
+        pendingWrites_.emplace(makeData_(OP_WRITE, fd, users_.generation(fd)), client->detachPendingWrite());
+    }
+    // 按user_data取消在途的recv/writev和CGI的poll；socket在请求结束后才真正释放
+    const uint64_t ops[] = { OP_RECV, OP_WRITE, OP_CGI + CgiProcess::STDIN, OP_CGI + CgiProcess::STDOUT,
+                             OP_CGI + CgiProcess::EXIT };
+    for(uint64_t op : ops) {
+        io_uring_sqe* sqe = ring_->getSqe();
+        if(!sqe) {
+            break;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = makeData_(static_cast<Op>(op), fd, users_.generation(fd));
+        sqe->user_data = makeData_(OP_CANCEL, fd, 0);
+    }
+    timer_->cancel(client->timerNode());
+    users_.release(fd);
+    client->closeHTTPConn();
+}
+
+void UringReactor::extentTime_(HTTPconnection* client)
+{
+    assert(client);
+    if(timeoutMS_>0)
+    {
+        timer_->update(client->timerNode(),timeoutMS_);
+    }
+}
+
+void UringReactor::handleRecv_(HTTPconnection* client, const io_uring_cqe* cqe) {
+    if(cqe->res == -ENOBUFS) {
+        // 缓冲区暂时耗尽，重新挂一次recv
+        armRecv_(client);
+        return;
+    }
+    if(cqe->res <= 0) {
+        closeConn_(client);
+        return;
+    }
+
+    const uint16_t bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    client->appendReadBuffer(ring_->bufAddr(bid), cqe->res);
+    ring_->recycleBuf(bid);
+    if(!(cqe->flags & IORING_CQE_F_MORE)) {
+        armRecv_(client);
+        if(client->isClosed()) {
+            return;
+        }
+    }
+
+    extentTime_(client);
+    // 有writev在途时先不处理，等写完后再继续解析缓冲区中的请求
+    if(client->writeBytes() == 0) {
+        onProcess_(client);
+    }
+}
+
+void UringReactor::handleWrite_(HTTPconnection* client, const io_uring_cqe* cqe) {
+    if(cqe->res <= 0) {
+        closeConn_(client, false);
+        return;
+    }
+    client->consumeWritten(cqe->res);
+    if(client->writeBytes() > 0) {
+        armWrite_(client);
+        return;
+    }
+    if(!client->isKeepAlive()) {
+        closeConn_(client);
+        return;
+    }
+    extentTime_(client);
+    onProcess_(client);
+}
+
+void UringReactor::onProcess_(HTTPconnection* client) {
+    if(client->handleHTTPConn()) {
+        armWrite_(client);
+        // 暂停期间缓冲的输出刚被取走，重新等待stdout
+        CgiProcess* cgi = client->cgi();
+        if(cgi && !client->isClosed() && cgi->resumeOutput()) {
+            armCgi_(client, CgiProcess::STDOUT);
+        }
+    }
+    else if(CgiProcess* cgi = client->startedCgi()) {
+        const CgiProcess::Channel channels[] = { CgiProcess::STDIN, CgiProcess::STDOUT, CgiProcess::EXIT };
+        for(CgiProcess::Channel channel : channels) {
+            if(cgi->fd(channel) >= 0) {
+                armCgi_(client, channel);
+            }
+        }
+    }
+}
+
+void UringReactor::armCgi_(HTTPconnection* client, CgiProcess::Channel channel) {
+    io_uring_sqe* sqe = ring_->getSqe();
+    if(!sqe) {
+        closeConn_(client);
+        return;
+    }
+    const int fd = client->getFd();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = client->cgi()->fd(channel);
+    // FastCGI连接在请求记录发完之前同时等待可写
+    sqe->poll32_events = channel == CgiProcess::STDIN ? POLLOUT : POLLIN;
+    if(channel == CgiProcess::STDOUT && client->cgi()->sending()) {
+        sqe->poll32_events |= POLLOUT;
+    }
+    sqe->user_data = makeData_(static_cast<Op>(OP_CGI + channel), fd, users_.generation(fd));
+}
+
+void UringReactor::onCgi_(HTTPconnection* client, CgiProcess::Channel channel) {
+    CgiProcess* cgi = client->cgi();
+    if(!cgi || cgi->finished()) {
+        return;
+    }
+    cgi->onReady(channel);
+    extentTime_(client);
+    const bool paused = channel == CgiProcess::STDOUT && cgi->outputPaused();
+    if(!cgi->finished() && cgi->fd(channel) >= 0 && !paused) {
+        armCgi_(client, channel);  // 读写到EAGAIN，通道未结束，重新等待；输出超过上限时等转发后再继续
+    }
+    // 有新的输出或子进程已结束：没有writev在途时立即转发，否则写完后由handleWrite_继续
+    if(!client->isClosed() && client->writeBytes() == 0) {
+        onProcess_(client);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+#include "connection_slab.h"
+#include "event_loop.h"
+#include "http_connection.h"
+#include "timer.h"
+#include "uring.h"
+
+// io_uring事件循环：multishot accept + provided buffer ring的multishot recv + writev
+// 与Reactor的run-to-completion模式一致，每个实例独占一个线程和一个SO_REUSEPORT监听socket
+class UringReactor : public EventLoop {
+public:
+    UringReactor(int listenFd, int timeoutMS);
+    ~UringReactor() override;
+
+    UringReactor(const UringReactor&) = delete;
+    UringReactor& operator=(const UringReactor&) = delete;
+
+    bool isValid() const override;
+    void loop() override;
+    void stop() override;
+
+    static const int MAX_FD = 65536;  // 不超过user_data中fd的24位
+
+private:
+    // user_data编码：op(8位) | fd(24位) | generation(32位)
+    enum Op : uint64_t {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_WRITE,
+        OP_CANCEL,
+        OP_CGI,  // 按CgiProcess::Channel顺序占用OP_CGI及之后的值
+    };
+    static uint64_t makeData_(Op op, int fd, uint32_t gen);
+
+    void handleCqe_(const io_uring_cqe* cqe);
+    void handleAccept_(const io_uring_cqe* cqe);
+    void handleRecv_(HTTPconnection* client, const io_uring_cqe* cqe);
+    void handleWrite_(HTTPconnection* client, const io_uring_cqe* cqe);
+
+    void armAccept_();
+    void armRecv_(HTTPconnection* client);
+    void armWrite_(HTTPconnection* client);
+    // CGI子进程的管道和pidfd用一次性POLL_ADD等待就绪，user_data中记录所属连接
+    void armCgi_(HTTPconnection* client, CgiProcess::Channel channel);
+    void onCgi_(HTTPconnection* client, CgiProcess::Channel channel);
+
+    void addClientConnection(int fd);
+    // 写缓冲区有数据时总有一个writev在途，只有处理它的完成事件期间例外，此时writing为false
+    void closeConn_(HTTPconnection* client, bool writing = true);
+    void onProcess_(HTTPconnection* client);
+    void extentTime_(HTTPconnection* client);
+
+    static const uint16_t BUF_GROUP = 0;
+    static const unsigned BUF_COUNT = 512;
+    static const unsigned BUF_SIZE = 16384;
+
+    int listenFd_;
+    int timeoutMS_;
+    bool isValid_;
+    std::atomic<bool> isClose_;
+
+    std::unique_ptr<Uring> ring_;
+    std::unique_ptr<TimerManager> timer_;
+    ConnectionSlab users_;  // 代数用于丢弃已关闭连接的迟到完成事件
+    // 关闭时仍在途的writev引用的写缓冲区和文件，按该writev的user_data保存，完成（或被取消）后释放
+    std::unordered_map<uint64_t, std::unique_ptr<HTTPconnection::PendingWrite>> pendingWrites_;
+};
+
+#endif  // URING_REACTOR_H
@@ -1,19 +1,27 @@
 #include "webserver.h"
 #include <netinet/tcp.h>
+#include <signal.h>
 #include <sys/resource.h>
 #include <sys/socket.h>  // 添加accept4支持
 #include <iostream>
 #include "date_cache.h"  // 添加Date缓存支持
+#include "file_cache.h"
+#include "precompress.h"
+#include "reactor.h"
+#include "uring_reactor.h"
 
 WebServer::WebServer(
-    int port, int trigMode, int timeoutMS, bool optLinger, int threadNum):
+    int port, int trigMode, int timeoutMS, bool optLinger, int threadNum, int reactorNum, bool ioUring,
+    bool precompress):
     port_(port),
     timeoutMS_(timeoutMS),
     isClose_(false),
-    listenFd_(-1),
     openLinger_(optLinger),
     srcDir_(nullptr)
 {
+    // sendfile没有MSG_NOSIGNAL，对端提前断开时由返回的EPIPE处理，不能让SIGPIPE结束进程
+    signal(SIGPIPE, SIG_IGN);
+
     // 启动Date头缓存
     startDateCache();
     
@@ -33,35 +41,89 @@ WebServer::WebServer(
 
     srcDir_ = getcwd(nullptr, 256);
     assert(srcDir_);
+    const std::string cwd(srcDir_);
     strncat(srcDir_, "/resources/", 16);
+    std::vector<std::string> cacheRoots{srcDir_};
+    if(precompress) {
+        // 压缩只在启动时做一次，请求处理时只查找副本
+        std::string dir = cwd + "/precompressed";
+        int count = precompressAssets(srcDir_, dir);
+        if(count < 0) {
+            std::cout<<"zlib/brotli unavailable, precompression disabled"<<std::endl;
+        } else {
+            std::cout<<"Precompressed "<<count<<" assets into "<<dir<<std::endl;
+            HTTPresponse::precompressDir = dir;
+            cacheRoots.push_back(dir);
+        }
+    }
+    // 静态资源的打开文件缓存，inotify监听资源目录和预压缩目录的变化
+    startFileCache(cacheRoots);
     
-    // 初始化组件
-    timer_ = std::make_unique<TimerManager>();
-    epoller_ = std::make_unique<Epoller>();
-    threadpool_ = std::make_unique<ThreadPool>(threadNum > 0 ? threadNum : 8);  // 确保线程数大于0
-
     // 初始化HTTP相关
     HTTPconnection::userCount = 0;
     HTTPconnection::srcDir = srcDir_;
 
     initEventMode_(trigMode);
-    if(!initSocket_()) {
-        isClose_ = true;
+    if(ioUring && reactorNum <= 0) {
+        reactorNum = 1;
+    }
+    if(reactorNum > 0) {
+        // 多Reactor模式：单线程处理连接，不需要EPOLLONESHOT；
+        // 连接固定使用ET，EPOLLIN|EPOLLOUT只注册一次
+        connectionEvent_ = (connectionEvent_ & ~EPOLLONESHOT) | EPOLLET;
+        HTTPconnection::isET = true;
+    } else {
+        threadpool_ = std::make_unique<ThreadPool>(threadNum > 0 ? threadNum : 8);  // 确保线程数大于0
+    }
+
+    // 每个Reactor一个监听socket，依靠SO_REUSEPORT由内核分发新连接
+    const int loops = reactorNum > 0 ? reactorNum : 1;
+    for(int i = 0; i < loops; ++i) {
+        int listenFd = initSocket_();
+        if(listenFd < 0) {
+            isClose_ = true;
+            break;
+        }
+        if(ioUring) {
+            auto uring = std::make_unique<UringReactor>(listenFd, timeoutMS_);
+            if(uring->isValid()) {
+                reactors_.push_back(std::move(uring));
+                continue;
+            }
+            // io_uring不可用（内核版本或seccomp限制）时整体回退到epoll：已创建的io_uring Reactor也一并重建，
+            // 保证所有Reactor与文件缓存的映射策略一致（io_uring的writev要求大文件也有映射）
+            std::cout<<"io_uring unavailable, falling back to epoll"<<std::endl;
+            ioUring = false;
+            reactors_.clear();
+            i = -1;
+            continue;
+        }
+        reactors_.push_back(std::make_unique<Reactor>(
+            listenFd, listenEvent_, connectionEvent_, timeoutMS_, threadpool_.get()));
+        if(!reactors_.back()->isValid()) {
+            isClose_ = true;
+            break;
+        }
+    }
+    // epoll后端用sendfile发送大文件，只有io_uring后端的writev需要把文件映射进内存
+    if(!ioUring) {
+        FileCache::getInstance().setMmapLimit(HTTPconnection::SENDFILE_THRESHOLD);
+    }
+    if(!isClose_) {
+        std::cout<<"Server port:"<<port_<<", reactors:"<<reactors_.size()<<std::endl;
     }
 }
 
 WebServer::~WebServer() {
-    if(listenFd_ != -1) {
-    close(listenFd_);
-        listenFd_ = -1;
-    }
     isClose_ = true;
+    reactors_.clear();
     if(srcDir_) {
     free(srcDir_);
         srcDir_ = nullptr;
     }
     // 停止Date头缓存
     stopDateCache();
+    stopFileCache();
 }
 
 void WebServer::initEventMode_(int trigMode) {
@@ -91,176 +153,45 @@ void WebServer::initEventMode_(int trigMode) {
 
 void WebServer::Start()
 {
-    int timeMS=-1;
-    if(!isClose_) 
-    {
-        std::cout<<"============================";
-        std::cout<<"Server Start!";
-        std::cout<<"============================";
-        std::cout<<std::endl;
-    }
-    while(!isClose_)
-    {
-        if(timeoutMS_>0)
-        {
-            timeMS=timer_->getNextHandle();
-        }
-        int eventCnt=epoller_->wait(timeMS);
-        for(int i=0;i<eventCnt;++i)
-        {
-            int fd=epoller_->getEventFd(i);
-            uint32_t events=epoller_->getEvents(i);
-
-            if(fd==listenFd_)
-            {
-                handleListen_();
-            }
-            else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                closeConn_(&users_[fd]);
-            }
-            else if(events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                handleRead_(&users_[fd]);
-            }
-            else if(events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                handleWrite_(&users_[fd]);
-            } 
-            else {
-                std::cout<<"Unexpected event"<<std::endl;
-            }
-        }
-    }
-}
-
-void WebServer::sendError_(int fd, const char* info)
-{
-    assert(fd>0);
-    int ret=send(fd,info,strlen(info),0);
-    if(ret<0)
-    {
-        std::cout<<"send error to client"<<fd<<" error!"<<std::endl;
-    }
-    close(fd);
-}
-
-void WebServer::closeConn_(HTTPconnection* client) {
-    assert(client);
-    epoller_->delFd(client->getFd());
-    client->closeHTTPConn();
-}
-
-void WebServer::addClientConnection(int fd, sockaddr_in addr)
-{
-    assert(fd>0);
-    
-    // 检查连接数限制
-    if(HTTPconnection::userCount >= MAX_FD - 100) { // 留一些余量
-        sendError_(fd, "Server busy!");
-        std::cout<<"Too many connections!"<<std::endl;
+    if(isClose_) {
         return;
     }
-    
-    users_[fd].initHTTPConn(fd,addr);
-    if(timeoutMS_>0)
-    {
-        timer_->addTimer(fd,timeoutMS_,std::bind(&WebServer::closeConn_,this,&users_[fd]));
-    }
-    epoller_->addFd(fd,EPOLLIN | connectionEvent_);
-}
+    std::cout<<"============================";
+    std::cout<<"Server Start!";
+    std::cout<<"============================";
+    std::cout<<std::endl;
 
-void WebServer::handleListen_() {
-    struct sockaddr_in addr;
-    do {
-        socklen_t len = sizeof(addr);  // 每次循环重置len
-        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
-        if(fd <= 0) { return;}
-        else if(HTTPconnection::userCount >= MAX_FD) {
-            sendError_(fd, "Server busy!");
-            std::cout<<"Clients is full!"<<std::endl;
-            return;
-        }
-        addClientConnection(fd, addr);
-    } while(listenEvent_ & EPOLLET);
-}
-
-void WebServer::handleRead_(HTTPconnection* client) {
-    assert(client);
-    extentTime_(client);
-    // 优化Lambda捕获，避免隐式拷贝
-    threadpool_->submit([this, conn = client]() {
-        this->onRead_(conn);
-    });
-}
-
-void WebServer::handleWrite_(HTTPconnection* client)
-{
-    assert(client);
-    extentTime_(client);
-    // 优化Lambda捕获，避免隐式拷贝
-    threadpool_->submit([this, conn = client]() {
-        this->onWrite_(conn);
-    });
-}
-
-void WebServer::extentTime_(HTTPconnection* client)
-{
-    assert(client);
-    if(timeoutMS_>0)
-    {
-        timer_->update(client->getFd(),timeoutMS_);
+    // Reactor 0 运行在主线程，其余各自一个线程并绑核
+    const size_t cpuCnt = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> loops;
+    loops.reserve(reactors_.size());
+    for(size_t i = 1; i < reactors_.size(); ++i) {
+        EventLoop* reactor = reactors_[i].get();
+        loops.emplace_back([reactor, i, cpuCnt] {
+            bindToCore(i % cpuCnt);
+            reactor->loop();
+        });
     }
-}
-
-void WebServer::onRead_(HTTPconnection* client) 
-{
-    assert(client);
-    int ret = -1;
-    int readErrno = 0;
-    ret = client->readBuffer(&readErrno);
-    if(ret <= 0 && readErrno != EAGAIN) {
-        closeConn_(client);
-        return;
+    if(reactors_.size() > 1) {
+        bindToCore(0);
     }
-    onProcess_(client);
-}
+    reactors_[0]->loop();
 
-void WebServer::onProcess_(HTTPconnection* client) 
-{
-    if(client->handleHTTPConn()) {
-        epoller_->modFd(client->getFd(), connectionEvent_ | EPOLLOUT);
-    } 
-    else {
-        epoller_->modFd(client->getFd(), connectionEvent_ | EPOLLIN);
+    for(auto& reactor : reactors_) {
+        reactor->stop();
     }
-}
-
-void WebServer::onWrite_(HTTPconnection* client) {
-    assert(client);
-    int ret = -1;
-    int writeErrno = 0;
-    ret = client->writeBuffer(&writeErrno);
-    if (client->writeBytes() == 0) {
-        if (client->isKeepAlive()) {
-            onProcess_(client);
-            return;
-        }
-    } else if (ret < 0) {
-        if (writeErrno == EAGAIN) {
-            epoller_->modFd(client->getFd(), connectionEvent_ | EPOLLOUT);
-            return;
-        }
+    for(auto& t : loops) {
+        t.join();
     }
-    closeConn_(client);
 }
 
-bool WebServer::initSocket_() {
+int WebServer::initSocket_() {
     int ret;
+    int listenFd;
     struct sockaddr_in addr;
     if(port_ > 65535 || port_ < 1024) {
         std::cout<<"Port number error!"<<std::endl;
-        return false;
+        return -1;
     }
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -271,84 +202,76 @@ bool WebServer::initSocket_() {
         optLinger.l_linger = 1;
     }
 
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if(listenFd_ < 0) {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listenFd < 0) {
         std::cout<<"Create socket error!"<<std::endl;
-        return false;
+        return -1;
     }
 
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
     if(ret < 0) {
-        close(listenFd_);
+        close(listenFd);
         std::cout<<"Init linger error!"<<std::endl;
-        return false;
+        return -1;
     }
 
     int optval = 1;
     // 启用地址重用
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
     if(ret == -1) {
         std::cout<<"set socket SO_REUSEADDR error !"<<std::endl;
-        close(listenFd_);
-        return false;
+        close(listenFd);
+        return -1;
     }
 
     // 启用端口重用，提高并发性能
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
     if(ret == -1) {
         std::cout<<"set socket SO_REUSEPORT error !"<<std::endl;
-        close(listenFd_);
-        return false;
+        close(listenFd);
+        return -1;
     }
 
     // 设置TCP_NODELAY，禁用Nagle算法
-    ret = setsockopt(listenFd_, IPPROTO_TCP, TCP_NODELAY, (const void*)&optval, sizeof(int));
+    ret = setsockopt(listenFd, IPPROTO_TCP, TCP_NODELAY, (const void*)&optval, sizeof(int));
     if(ret == -1) {
         std::cout<<"set socket TCP_NODELAY error !"<<std::endl;
-        close(listenFd_);
-        return false;
+        close(listenFd);
+        return -1;
     }
 
     // 设置接收缓冲区大小
     int rcvbuf = 262144; // 256KB
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
     if(ret == -1) {
         std::cout<<"set socket SO_RCVBUF error !"<<std::endl;
     }
 
     // 设置发送缓冲区大小
     int sndbuf = 262144; // 256KB
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
     if(ret == -1) {
         std::cout<<"set socket SO_SNDBUF error !"<<std::endl;
     }
 
-    ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr));
+    ret = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
     if(ret < 0) {
         std::cout<<"Bind Port"<<port_<<" error!"<<std::endl;
-        close(listenFd_);
-        return false;
+        close(listenFd);
+        return -1;
     }
 
     // 增大backlog到1024，提高连接处理能力
-    ret = listen(listenFd_, 1024);
+    ret = listen(listenFd, 1024);
     if(ret < 0) {
         std::cout<<"Listen error!"<<std::endl;
-        close(listenFd_);
-        return false;
+        close(listenFd);
+        return -1;
     }
     
     // 先设置非阻塞，再添加到epoll，提高容错性
-    setFdNonblock(listenFd_);
-    
-    ret = epoller_->addFd(listenFd_,  listenEvent_ | EPOLLIN);
-    if(ret == 0) {
-        std::cout<<"Add listen fd to epoll error!"<<std::endl;
-        close(listenFd_);
-        return false;
-    }
-    std::cout<<"Server port:"<<port_<<std::endl;
-    return true;
+    setFdNonblock(listenFd);
+    return listenFd;
 }
 
 int WebServer::setFdNonblock(int fd) {
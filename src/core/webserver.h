@@ -9,56 +9,42 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
-#include <unordered_map>
 #include <memory>
+#include <vector>
 
+#include "event_loop.h"
 #include "http_connection.h"
-#include "epoller.h"
 #include "threadpool.h"
-#include "timer.h"
 
 class WebServer {
 public:
-    WebServer(int port, int trigMode, int timeoutMS, bool optLinger, int threadNum);
+    // reactorNum为0时：主线程单epoll循环 + 线程池（EPOLLONESHOT分发）
+    // reactorNum大于0时：每个核一个Reactor，各自拥有SO_REUSEPORT监听socket，请求在本线程内处理完成
+    // ioUring为true时事件循环改用io_uring后端（不可用时回退到epoll），至少一个循环
+    // precompress为true时启动前把文本资源预压缩到./precompressed，按Accept-Encoding发送
+    WebServer(int port, int trigMode, int timeoutMS, bool optLinger, int threadNum,
+              int reactorNum = 0, bool ioUring = false, bool precompress = false);
     ~WebServer();
     void Start();
 
 private:
-    bool initSocket_();
+    int initSocket_();
 
     void initEventMode_(int trigMode);
 
-    void addClientConnection(int fd, sockaddr_in addr);  //添加一个HTTP连接
-    void closeConn_(HTTPconnection* client);             //关闭一个HTTP连接
-
-    void handleListen_();
-    void handleWrite_(HTTPconnection* client);
-    void handleRead_(HTTPconnection* client);
-
-    void onRead_(HTTPconnection* client);
-    void onWrite_(HTTPconnection* client);
-    void onProcess_(HTTPconnection* client);
-
-    void sendError_(int fd, const char* info);
-    void extentTime_(HTTPconnection* client);
-
-    static const int MAX_FD = 65536;
     static int setFdNonblock(int fd);
 
     int port_;
     int timeoutMS_;
     bool isClose_;
-    int listenFd_;
     bool openLinger_;
     char* srcDir_;
 
     uint32_t listenEvent_;
     uint32_t connectionEvent_;
 
-    std::unique_ptr<TimerManager> timer_;
     std::unique_ptr<ThreadPool> threadpool_;
-    std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HTTPconnection> users_;
+    std::vector<std::unique_ptr<EventLoop>> reactors_;
 };
 
 #endif  // WEBSERVER_H
\ No newline at end of file
@@ -1,14 +1,22 @@
 #include "cgi_handler.h"
 #include "buffer.h"
+#include "cgi_process.h"
+#include "fastcgi_client.h"
 #include <iostream>
-#include <sys/wait.h>
 #include <unistd.h>
 #include <cstdlib>
 #include <cstring>
+#include <strings.h>
+#include <cctype>
 #include <sys/stat.h>
 
 CGIHandler::CGIHandler() {
     cgiDir_ = "./cgi-bin/";  // 相对于当前工作目录
+    // FastCGI后端不在同一工作目录下，SCRIPT_FILENAME需要绝对路径
+    char cwd[256];
+    if (getcwd(cwd, sizeof(cwd))) {
+        cgiRoot_ = std::string(cwd) + "/cgi-bin/";
+    }
 }
 
 CGIHandler::~CGIHandler() {
@@ -26,9 +34,9 @@ std::string CGIHandler::getCGIScriptPath(const std::string& path) {
     return "";
 }
 
-bool CGIHandler::handleCGI(const std::string& path, const std::string& method, 
-                          const std::string& body, const std::string& queryString,
-                          Buffer& response) {
+bool CGIHandler::handleCGI(const std::string& path, std::string_view method, 
+                          std::string_view body, std::string_view queryString,
+                          Buffer& response, std::unique_ptr<CgiProcess>* async) {
     
     if (!isCGIPath(path)) {
         return false;
@@ -36,56 +44,158 @@ bool CGIHandler::handleCGI(const std::string& path, const std::string& method,
     
     std::string scriptPath = getCGIScriptPath(path);
     if (scriptPath.empty()) {
-        response.append("HTTP/1.1 404 Not Found\r\n");
-        response.append("Content-Type: text/html\r\n");
-        response.append("Connection: close\r\n\r\n");
-        response.append("<html><body><h1>404 - CGI Script Not Found</h1></body></html>");
-        return true;
-    }
-    
-    // 检查脚本文件是否存在
-    struct stat st;
-    if (stat(scriptPath.c_str(), &st) != 0) {
-        response.append("HTTP/1.1 404 Not Found\r\n");
-        response.append("Content-Type: text/html\r\n");
-        response.append("Connection: close\r\n\r\n");
-        response.append("<html><body><h1>404 - CGI Script Not Found: " + scriptPath + "</h1></body></html>");
+        response.append("HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n"
+                        "<html><body><h1>404 - CGI Script Not Found</h1></body></html>");
         return true;
     }
     
     // 设置CGI环境变量
     std::unordered_map<std::string, std::string> env;
     setEnvironmentVariables(method, path, queryString, body, env);
+    env["SCRIPT_FILENAME"] = cgiRoot_ + path.substr(9);
     
-    // 执行CGI脚本
-    std::string output = executeCGI(scriptPath, env, body);
-    
-    // 检查输出是否包含HTTP头
-    if (output.find("Content-Type:") == std::string::npos) {
-        // 如果CGI脚本没有提供HTTP头，我们添加默认头
-        response.append("HTTP/1.1 200 OK\r\n");
-        response.append("Content-Type: text/html\r\n");
-        response.append("Connection: close\r\n");
-        response.append("Content-Length: " + std::to_string(output.length()) + "\r\n\r\n");
+    std::string output;
+    // 配置了FastCGI后端的路径交给常驻进程处理，脚本是否存在由后端判断
+    if (FastCGIPool::getInstance().start(path, env, body, async)) {
+        if (*async) {
+            return true;  // 与子进程一样由事件循环收发，不在这里等待后端
+        }
+        output = FastCGIPool::BAD_GATEWAY;
     } else {
-        // 如果CGI脚本提供了头，添加HTTP状态行
-        response.append("HTTP/1.1 200 OK\r\n");
+        // 检查脚本文件是否存在
+        struct stat st;
+        if (stat(scriptPath.c_str(), &st) != 0) {
+            response.appendAll("HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n"
+                               "<html><body><h1>404 - CGI Script Not Found: ", scriptPath, "</h1></body></html>");
+            return true;
+        }
+        // 执行CGI脚本
+        std::unique_ptr<CgiProcess> proc = CgiProcess::spawn(scriptPath, env, body);
+        if (!proc) {
+            output = "Content-Type: text/html\r\n\r\n<html><body><h1>500 - CGI Execution Error</h1>"
+                     "<p>Failed to start script</p></body></html>";
+        } else {
+            *async = std::move(proc);  // 由事件循环驱动子进程，不在这里等待
+            return true;
+        }
     }
     
-    response.append(output);
+    writeResponse(output, response);
     return true;
 }
 
-void CGIHandler::setEnvironmentVariables(const std::string& method, 
+void CGIHandler::writeResponse(std::string_view output, Buffer& response) {
+    if (output.empty()) {
+        output = "Content-Type: text/html\r\n\r\n<html><body><h1>500 - CGI Error</h1><p>No output from CGI script</p></body></html>";
+    }
+    bool hasLength = false;
+    std::string_view body = output.substr(writeHead(output, true, response, &hasLength));
+    if (!hasLength) {
+        response.appendAll("Content-Length: ", body.size(), "\r\n");
+    }
+    response.appendAll("Connection: close\r\n\r\n", body);
+}
+
+namespace {
+// 超过该长度还没有结束的头块不再当作响应头
+const size_t MAX_CGI_HEAD = 8192;
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+bool headerIs(std::string_view name, std::string_view expect) {
+    return name.size() == expect.size() && strncasecmp(name.data(), expect.data(), expect.size()) == 0;
+}
+
+// 从头块中取出下一个响应头，跳过空行
+bool nextHeader(std::string_view* head, std::string_view* name, std::string_view* value) {
+    while (!head->empty()) {
+        size_t nl = head->find('\n');
+        std::string_view line = head->substr(0, nl);
+        head->remove_prefix(nl == std::string_view::npos ? head->size() : nl + 1);
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos) {
+            *name = trim(line.substr(0, colon));
+            *value = trim(line.substr(colon + 1));
+            return true;
+        }
+    }
+    return false;
+}
+}  // namespace
+
+long CGIHandler::writeHead(std::string_view output, bool complete, Buffer& response, bool* hasLength) {
+    *hasLength = false;
+    // 找到结束头块的空行，并确认之前的每一行都是响应头
+    size_t end = std::string_view::npos;
+    for (size_t pos = 0; pos < output.size() && pos < MAX_CGI_HEAD;) {
+        size_t nl = output.find('\n', pos);
+        if (nl == std::string_view::npos) {
+            break;
+        }
+        std::string_view line = trim(output.substr(pos, nl - pos));
+        if (line.empty() || line.find(':') == std::string_view::npos) {
+            end = line.empty() ? nl + 1 : 0;
+            break;
+        }
+        pos = nl + 1;
+    }
+    if (end == std::string_view::npos) {
+        if (!complete && output.size() < MAX_CGI_HEAD) {
+            return -1;
+        }
+        end = 0;
+    }
+
+    // Status头给出状态码，只有Location时是重定向（CGI/1.1 6.2节）
+    std::string_view head = output.substr(0, end);
+    std::string_view status = "200 OK";
+    std::string_view name, value;
+    for (std::string_view rest = head; nextHeader(&rest, &name, &value);) {
+        if (headerIs(name, "Status") && value.size() >= 3 && isdigit(value[0]) && isdigit(value[1]) &&
+            isdigit(value[2])) {
+            status = value;
+            break;
+        }
+        if (headerIs(name, "Location")) {
+            status = "302 Found";
+        }
+    }
+    response.appendAll("HTTP/1.1 ", status, "\r\n");
+
+    // 连接管理相关的头由服务器决定
+    bool hasType = false;
+    for (std::string_view rest = head; nextHeader(&rest, &name, &value);) {
+        if (headerIs(name, "Status") || headerIs(name, "Connection") || headerIs(name, "Transfer-Encoding")) {
+            continue;
+        }
+        *hasLength = *hasLength || headerIs(name, "Content-Length");
+        hasType = hasType || headerIs(name, "Content-Type");
+        response.appendAll(name, ": ", value, "\r\n");
+    }
+    if (!hasType) {
+        response.append("Content-Type: text/html\r\n");
+    }
+    return static_cast<long>(end);
+}
+
+void CGIHandler::setEnvironmentVariables(std::string_view method, 
                                         const std::string& path,
-                                        const std::string& queryString,
-                                        const std::string& body,
+                                        std::string_view queryString,
+                                        std::string_view body,
                                         std::unordered_map<std::string, std::string>& env) {
     
-    env["REQUEST_METHOD"] = method;
+    env["REQUEST_METHOD"] = std::string(method);
     env["SCRIPT_NAME"] = path;
     env["PATH_INFO"] = path;
-    env["QUERY_STRING"] = queryString;
+    env["QUERY_STRING"] = std::string(queryString);
     env["SERVER_SOFTWARE"] = "C++WebServer/2.0";
     env["SERVER_NAME"] = "localhost";
     env["SERVER_PORT"] = "8000";
@@ -100,91 +210,3 @@ void CGIHandler::setEnvironmentVariables(const std::string& method,
         env["CONTENT_LENGTH"] = std::to_string(body.length());
     }
 }
-
-std::string CGIHandler::executeCGI(const std::string& scriptPath, 
-                                  const std::unordered_map<std::string, std::string>& env,
-                                  const std::string& body) {
-    
-    int pipefd[2];
-    int stdin_pipe[2];  // 为stdin创建管道
-    
-    if (pipe(pipefd) == -1 || pipe(stdin_pipe) == -1) {
-        return "<html><body><h1>500 - CGI Execution Error</h1><p>Failed to create pipe</p></body></html>";
-    }
-    
-    pid_t pid = fork();
-    if (pid == -1) {
-        close(pipefd[0]);
-        close(pipefd[1]);
-        close(stdin_pipe[0]);
-        close(stdin_pipe[1]);
-        return "<html><body><h1>500 - CGI Execution Error</h1><p>Failed to fork process</p></body></html>";
-    }
-    
-    if (pid == 0) {
-        // 子进程
-        close(pipefd[0]); // 关闭stdout读端
-        close(stdin_pipe[1]); // 关闭stdin写端
-        
-        dup2(pipefd[1], STDOUT_FILENO); // 重定向stdout到管道
-        dup2(stdin_pipe[0], STDIN_FILENO); // 重定向stdin从管道读取
-        
-        close(pipefd[1]);
-        close(stdin_pipe[0]);
-        
-        // 设置环境变量
-        for (const auto& pair : env) {
-            setenv(pair.first.c_str(), pair.second.c_str(), 1);
-        }
-        
-        // 执行CGI脚本
-        execlp("python3", "python3", scriptPath.c_str(), nullptr);
-        
-        // 如果execlp失败
-        std::cout << "Content-Type: text/html\r\n\r\n";
-        std::cout << "<html><body><h1>500 - CGI Execution Error</h1>";
-        std::cout << "<p>Failed to execute script: " << scriptPath << "</p></body></html>";
-        exit(1);
-    } else {
-        // 父进程
-        close(pipefd[1]); // 关闭stdout写端
-        close(stdin_pipe[0]); // 关闭stdin读端
-        
-        // 获取POST数据并写入stdin管道（直接从环境变量获取Content-Length）
-        auto contentLengthIt = env.find("CONTENT_LENGTH");
-        if (contentLengthIt != env.end() && !contentLengthIt->second.empty()) {
-            int contentLength = std::stoi(contentLengthIt->second);
-            if (contentLength > 0) {
-                // 直接使用传入的body数据，检查write返回值
-                ssize_t written = write(stdin_pipe[1], body.c_str(), body.length());
-                if (written < 0) {
-                    // 写入失败，但继续执行CGI（某些CGI脚本可能不需要POST数据）
-                    // 可以选择记录错误或处理，这里选择静默处理
-                    (void)written; // 避免未使用变量警告
-                }
-            }
-        }
-        close(stdin_pipe[1]); // 关闭stdin写端，告诉CGI脚本没有更多数据
-        
-        std::string output;
-        char buffer[4096];
-        ssize_t bytesRead;
-        
-        while ((bytesRead = read(pipefd[0], buffer, sizeof(buffer) - 1)) > 0) {
-            buffer[bytesRead] = '\0';
-            output += buffer;
-        }
-        
-        close(pipefd[0]);
-        
-        // 等待子进程结束
-        int status;
-        waitpid(pid, &status, 0);
-        
-        if (output.empty()) {
-            output = "Content-Type: text/html\r\n\r\n<html><body><h1>500 - CGI Error</h1><p>No output from CGI script</p></body></html>";
-        }
-        
-        return output;
-    }
-} 
\ No newline at end of file
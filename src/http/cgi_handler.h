@@ -1,29 +1,39 @@
 #ifndef CGI_HANDLER_H
 #define CGI_HANDLER_H
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 class Buffer;
+class CgiProcess;
 
 class CGIHandler {
 public:
     CGIHandler();
     ~CGIHandler();
     
-    bool handleCGI(const std::string& path, const std::string& method, 
-                   const std::string& body, const std::string& queryString,
-                   Buffer& response);
+    // 脚本以子进程异步执行，FastCGI请求也异步转发给后端：启动成功后存入*async，response不写入任何内容，
+    // 由调用方用writeHead和它的输出生成响应；其余情况（错误）同步写入response
+    bool handleCGI(const std::string& path, std::string_view method, 
+                   std::string_view body, std::string_view queryString,
+                   Buffer& response, std::unique_ptr<CgiProcess>* async);
+
+    // 把完整的CGI输出（可能以Content-Type等响应头开头）整理成带Content-Length的HTTP响应
+    static void writeResponse(std::string_view output, Buffer& response);
+
+    // 把CGI输出开头的响应头块（若干"名字: 值"行加一个空行）转换成状态行和响应头写入response，不含结尾的空行
+    // 返回头块的长度，之后都是内容；输出不以响应头开头时写入默认头并返回0
+    // 头块还没收全且complete为false时不写入并返回-1；*hasLength表示脚本是否给出了Content-Length
+    static long writeHead(std::string_view output, bool complete, Buffer& response, bool* hasLength);
 
 private:
-    std::string executeCGI(const std::string& scriptPath, 
-                          const std::unordered_map<std::string, std::string>& env,
-                          const std::string& body);
     
-    void setEnvironmentVariables(const std::string& method, 
+    void setEnvironmentVariables(std::string_view method, 
                                const std::string& path,
-                               const std::string& queryString,
-                               const std::string& body,
+                               std::string_view queryString,
+                               std::string_view body,
                                std::unordered_map<std::string, std::string>& env);
     
     bool isCGIPath(const std::string& path);
@@ -31,6 +41,7 @@ private:
     
     // CGI脚本根目录
     std::string cgiDir_;
+    std::string cgiRoot_;  // cgiDir_的绝对路径
 };
 
 #endif // CGI_HANDLER_H 
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "cgi_process.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+namespace {
+// 被提前终止（连接关闭）时还没退出的子进程，之后再用WNOHANG回收，避免阻塞
+std::mutex orphanMtx;
+std::vector<pid_t> orphans;
+}
+
+void CgiProcess::reapOrphans_() {
+    std::lock_guard<std::mutex> lock(orphanMtx);
+    for (size_t i = 0; i < orphans.size();) {
+        if (waitpid(orphans[i], nullptr, WNOHANG) != 0) {
+            orphans[i] = orphans.back();
+            orphans.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+// 子进程的环境：CGI变量加上服务器自身的环境（PATH等），同名时CGI变量优先
+// 在父进程中事先构造好，posix_spawn的子进程与父进程共享内存，不能再分配内存或调用setenv
+std::vector<std::string> CgiProcess::buildEnv_(const std::unordered_map<std::string, std::string>& env) {
+    std::vector<std::string> entries;
+    entries.reserve(env.size() + 32);
+    for (const auto& pair : env) {
+        entries.push_back(pair.first + "=" + pair.second);
+    }
+    for (char** e = environ; *e; ++e) {
+        const char* eq = strchr(*e, '=');
+        if (eq && env.find(std::string(*e, eq - *e)) == env.end()) {
+            entries.emplace_back(*e);
+        }
+    }
+    return entries;
+}
+
+std::unique_ptr<CgiProcess> CgiProcess::spawn(const std::string& scriptPath,
+                                              const std::unordered_map<std::string, std::string>& env,
+                                              std::string_view body) {
+    reapOrphans_();
+
+    // 服务器的fd都带CLOEXEC，子进程只继承dup2得到的stdin/stdout（以及stderr）
+    int pipefd[2];
+    int stdin_pipe[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        return nullptr;
+    }
+    if (pipe2(stdin_pipe, O_CLOEXEC) == -1) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return nullptr;
+    }
+
+    std::vector<std::string> entries = buildEnv_(env);
+    std::vector<char*> envp;
+    envp.reserve(entries.size() + 1);
+    for (std::string& entry : entries) {
+        envp.push_back(&entry[0]);
+    }
+    envp.push_back(nullptr);
+    char* argv[] = {const_cast<char*>("python3"), const_cast<char*>(scriptPath.c_str()), nullptr};
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, stdin_pipe[0], STDIN_FILENO);
+    // 服务器忽略了SIGPIPE，子进程恢复默认处理
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t sigdef, sigmask;
+    sigemptyset(&sigdef);
+    sigaddset(&sigdef, SIGPIPE);
+    sigemptyset(&sigmask);
+    posix_spawnattr_setsigdefault(&attr, &sigdef);
+    posix_spawnattr_setsigmask(&attr, &sigmask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+    // glibc以CLONE_VM|CLONE_VFORK创建子进程，不复制页表，exec失败时在这里返回错误
+    pid_t pid = -1;
+    int err = posix_spawnp(&pid, "python3", &actions, &attr, argv, envp.data());
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        std::cout << "Failed to execute CGI script " << scriptPath << ": " << strerror(err) << std::endl;
+        close(pipefd[0]);
+        close(pipefd[1]);
+        close(stdin_pipe[0]);
+        close(stdin_pipe[1]);
+        return nullptr;
+    }
+
+    close(pipefd[1]);
+    close(stdin_pipe[0]);
+    std::unique_ptr<CgiProcess> proc(new CgiProcess());
+    proc->pid_ = pid;
+    proc->fds_[STDOUT].reset(pipefd[0]);
+    proc->fds_[STDIN].reset(stdin_pipe[1]);
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+    fcntl(stdin_pipe[1], F_SETFL, O_NONBLOCK);
+
+    // 不支持pidfd（内核早于5.3或被seccomp禁止）时没有EXIT通道，以stdout的EOF作为结束
+    int pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd >= 0) {
+        fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+        proc->fds_[EXIT].reset(pidfd);
+    }
+
+    // 请求体一般能一次写进管道缓冲区，写不下的部分才拷贝，等待可写时继续
+    if (!body.empty()) {
+        ssize_t n = write(stdin_pipe[1], body.data(), body.size());
+        size_t done = n > 0 ? n : 0;
+        if (done < body.size() && (n >= 0 || errno == EAGAIN)) {
+            proc->pendingBody_.assign(body.data() + done, body.size() - done);
+            return proc;
+        }
+    }
+    proc->fds_[STDIN].reset();  // 关闭stdin，告诉CGI脚本没有更多数据
+    return proc;
+}
+
+CgiProcess::~CgiProcess() {
+    if (pid_ > 0 && !exited_) {
+        // 连接在子进程结束前关闭：终止子进程，来不及退出的留给之后的spawn回收
+        kill(pid_, SIGKILL);
+        if (waitpid(pid_, nullptr, WNOHANG) == 0) {
+            std::lock_guard<std::mutex> lock(orphanMtx);
+            orphans.push_back(pid_);
+        }
+    }
+}
+
+void CgiProcess::onReady(Channel channel) {
+    if (!fds_[channel]) {
+        return;
+    }
+    if (channel == STDIN) {
+        writeInput_();
+    } else if (channel == STDOUT) {
+        readOutput_();
+    } else {
+        reap_();
+    }
+    finished_ = exited_ && !fds_[STDOUT];
+}
+
+void CgiProcess::writeInput_() {
+    while (written_ < pendingBody_.size()) {
+        ssize_t n = write(fds_[STDIN].get(), pendingBody_.data() + written_, pendingBody_.size() - written_);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                return;
+            }
+            break;  // EPIPE：脚本不再读取请求体
+        }
+        written_ += n;
+    }
+    fds_[STDIN].reset();
+    std::string().swap(pendingBody_);
+}
+
+void CgiProcess::readOutput_() {
+    int err = 0;
+    while (true) {
+        if (output_.readableBytes() >= MAX_BUFFERED) {
+            outputPaused_ = true;  // 管道中剩下的输出等连接取走已缓冲的部分后再读
+            return;
+        }
+        ssize_t n = output_.readFd(fds_[STDOUT].get(), &err);
+        if (n > 0 || (n < 0 && err == EINTR)) {
+            continue;
+        }
+        if (n < 0 && err == EAGAIN) {
+            return;
+        }
+        break;  // EOF或出错
+    }
+    fds_[STDOUT].reset();
+    if (!fds_[EXIT] && !exited_) {
+        // 没有pidfd：子进程关闭stdout后视为结束，还没退出的不终止，留给之后的spawn回收
+        if (waitpid(pid_, nullptr, WNOHANG) == 0) {
+            std::lock_guard<std::mutex> lock(orphanMtx);
+            orphans.push_back(pid_);
+        }
+        exited_ = true;
+        fds_[STDIN].reset();
+        std::string().swap(pendingBody_);
+    }
+}
+
+bool CgiProcess::resumeOutput() {
+    if (!outputPaused_ || output_.readableBytes() >= MAX_BUFFERED) {
+        return false;
+    }
+    outputPaused_ = false;
+    return static_cast<bool>(fds_[STDOUT]);
+}
+
+void CgiProcess::reap_() {
+    if (waitpid(pid_, nullptr, WNOHANG) == 0) {
+        return;  // pidfd可读时子进程已经退出，不会发生
+    }
+    exited_ = true;
+    fds_[EXIT].reset();
+    // 子进程已经退出，没写完的请求体不再需要
+    fds_[STDIN].reset();
+    std::string().swap(pendingBody_);
+}
@@ -0,0 +1,92 @@
+#ifndef CGI_PROCESS_H
+#define CGI_PROCESS_H
+
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.h"
+#include "unique_fd.h"
+
+// 一个运行中的CGI子进程：stdin/stdout管道和pidfd都是非阻塞fd，由事件循环在就绪时驱动
+// 请求体先尽量直接写入管道，写不下的部分才拷贝保存；输出读入output_，子进程退出且stdout读到EOF后完成
+// 连接可以在运行期间边读边转发output_中已有的输出；缓冲的输出达到MAX_BUFFERED时暂停读取stdout，
+// 子进程阻塞在写满的管道上，客户端读得慢时服务器不会缓冲全部输出
+// 转发给FastCGI后端的请求（FastCGIRequest）以同样的接口由事件循环驱动
+class CgiProcess {
+public:
+    enum Channel {
+        STDIN = 0,
+        STDOUT,
+        EXIT,  // pidfd，子进程退出时可读；不支持pidfd时为-1，以stdout的EOF作为结束
+        CHANNEL_COUNT,
+    };
+
+    // 以posix_spawn启动python3执行脚本，启动失败（pipe/spawn出错）时返回nullptr
+    static std::unique_ptr<CgiProcess> spawn(const std::string& scriptPath,
+                                             const std::unordered_map<std::string, std::string>& env,
+                                             std::string_view body);
+    virtual ~CgiProcess();
+
+    CgiProcess(const CgiProcess&) = delete;
+    CgiProcess& operator=(const CgiProcess&) = delete;
+
+    static const size_t MAX_BUFFERED = 256 * 1024;
+
+    // 仍需等待的fd，该通道已结束时为-1
+    int fd(Channel channel) const {
+        return fds_[channel].get();
+    }
+
+    // 通道就绪：写请求体或读输出直到EAGAIN（或缓冲达到上限），通道结束时关闭对应fd
+    virtual void onReady(Channel channel);
+
+    // stdout通道的fd除可读外还要等待可写：FastCGI连接在请求记录发完之前同时等待两者
+    bool sending() const {
+        return sending_;
+    }
+
+    // stdout的事件是一次性的，暂停期间事件循环不再等待它
+    bool outputPaused() const {
+        return outputPaused_;
+    }
+    // 输出被取走后解除暂停，返回true时事件循环应重新等待stdout
+    bool resumeOutput();
+
+    bool finished() const {
+        return finished_;
+    }
+    // 已读到但还没被取走的输出，取走的部分用updateReadPtr丢弃
+    Buffer& output() {
+        return output_;
+    }
+
+protected:
+    CgiProcess() = default;
+
+    bool finished_ = false;
+    bool sending_ = false;
+    unique_fd fds_[CHANNEL_COUNT];
+    Buffer output_;
+    bool outputPaused_ = false;
+
+private:
+    void writeInput_();
+    void readOutput_();
+    void reap_();
+
+    static void reapOrphans_();
+    static std::vector<std::string> buildEnv_(const std::unordered_map<std::string, std::string>& env);
+
+    pid_t pid_ = -1;
+    bool exited_ = false;
+
+    std::string pendingBody_;  // 启动时没能写进管道的请求体
+    size_t written_ = 0;
+};
+
+#endif  // CGI_PROCESS_H
@@ -0,0 +1,266 @@
+#include "fastcgi_client.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+// FastCGI 1.0记录格式，见FastCGI Specification第8节
+const uint8_t FCGI_VERSION_1 = 1;
+const uint8_t FCGI_BEGIN_REQUEST = 1;
+const uint8_t FCGI_END_REQUEST = 3;
+const uint8_t FCGI_PARAMS = 4;
+const uint8_t FCGI_STDIN = 5;
+const uint8_t FCGI_STDOUT = 6;
+const uint8_t FCGI_STDERR = 7;
+const uint8_t FCGI_RESPONDER = 1;
+const uint8_t FCGI_KEEP_CONN = 1;
+const uint8_t FCGI_REQUEST_COMPLETE = 0;
+
+const uint16_t REQUEST_ID = 1;  // 每条连接同时只有一个请求
+const size_t HEADER_LEN = 8;
+const size_t MAX_CONTENT = 65535;
+
+void appendHeader(std::string* out, uint8_t type, size_t len) {
+    const char header[HEADER_LEN] = {
+        static_cast<char>(FCGI_VERSION_1), static_cast<char>(type),
+        static_cast<char>(REQUEST_ID >> 8), static_cast<char>(REQUEST_ID & 0xff),
+        static_cast<char>(len >> 8), static_cast<char>(len & 0xff), 0, 0};
+    out->append(header, HEADER_LEN);
+}
+
+// 名值对的长度：小于128用1字节，否则4字节且最高位置1
+void appendLength(std::string* out, size_t len) {
+    if (len < 128) {
+        out->push_back(static_cast<char>(len));
+        return;
+    }
+    out->push_back(static_cast<char>(((len >> 24) & 0x7f) | 0x80));
+    out->push_back(static_cast<char>((len >> 16) & 0xff));
+    out->push_back(static_cast<char>((len >> 8) & 0xff));
+    out->push_back(static_cast<char>(len & 0xff));
+}
+
+// 把data按不超过65535字节分成若干type记录
+void appendStream(std::string* out, uint8_t type, std::string_view data) {
+    for (size_t off = 0; off < data.size(); off += MAX_CONTENT) {
+        size_t len = std::min(MAX_CONTENT, data.size() - off);
+        appendHeader(out, type, len);
+        out->append(data.data() + off, len);
+    }
+}
+}  // namespace
+
+void FastCGIPool::addBackend(const std::string& prefix, const std::string& socketPath) {
+    auto backend = std::make_unique<Backend>();
+    backend->prefix = prefix;
+    backend->socketPath = socketPath;
+    backends_.push_back(std::move(backend));
+}
+
+FastCGIPool::Backend* FastCGIPool::match_(std::string_view path) const {
+    Backend* best = nullptr;
+    for (const auto& backend : backends_) {
+        if (path.compare(0, backend->prefix.size(), backend->prefix) == 0 &&
+            (!best || backend->prefix.size() > best->prefix.size())) {
+            best = backend.get();
+        }
+    }
+    return best;
+}
+
+bool FastCGIPool::start(std::string_view path, const std::unordered_map<std::string, std::string>& env,
+                        std::string_view body, std::unique_ptr<CgiProcess>* async) {
+    Backend* backend = match_(path);
+    if (!backend) {
+        return false;
+    }
+    bool reused = false;
+    unique_fd conn = acquire_(*backend, &reused);
+    if (!conn) {
+        std::cout << "FastCGI backend " << backend->socketPath << " unavailable" << std::endl;
+        return true;
+    }
+    async->reset(new FastCGIRequest(backend, std::move(conn), reused, buildRequest_(env, body)));
+    return true;
+}
+
+unique_fd FastCGIPool::acquire_(Backend& backend, bool* reused) {
+    {
+        std::lock_guard<std::mutex> lock(backend.mtx);
+        if (!backend.idle.empty()) {
+            unique_fd conn = std::move(backend.idle.back());
+            backend.idle.pop_back();
+            *reused = true;
+            return conn;
+        }
+    }
+    *reused = false;
+    return connect_(backend.socketPath);
+}
+
+void FastCGIPool::release_(Backend& backend, unique_fd conn) {
+    std::lock_guard<std::mutex> lock(backend.mtx);
+    if (backend.idle.size() < MAX_IDLE_PER_BACKEND) {
+        backend.idle.push_back(std::move(conn));
+    }
+}
+
+unique_fd FastCGIPool::connect_(const std::string& socketPath) {
+    struct sockaddr_un addr = {};
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        return unique_fd();
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    unique_fd fd(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (!fd) {
+        return unique_fd();
+    }
+    // Unix socket的非阻塞connect立即完成，后端的监听队列满时返回EAGAIN，与后端不在监听一样视为不可用
+    if (connect(fd.get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        return unique_fd();
+    }
+    return fd;
+}
+
+std::string FastCGIPool::buildRequest_(const std::unordered_map<std::string, std::string>& env,
+                                       std::string_view body) {
+    std::string params;
+    for (const auto& pair : env) {
+        appendLength(&params, pair.first.size());
+        appendLength(&params, pair.second.size());
+        params += pair.first;
+        params += pair.second;
+    }
+
+    std::string out;
+    out.reserve(params.size() + body.size() + (params.size() + body.size()) / MAX_CONTENT * HEADER_LEN +
+                6 * HEADER_LEN);
+    appendHeader(&out, FCGI_BEGIN_REQUEST, 8);
+    const char begin[8] = {0, static_cast<char>(FCGI_RESPONDER), static_cast<char>(FCGI_KEEP_CONN)};
+    out.append(begin, sizeof(begin));
+    appendStream(&out, FCGI_PARAMS, params);
+    appendHeader(&out, FCGI_PARAMS, 0);
+    appendStream(&out, FCGI_STDIN, body);
+    appendHeader(&out, FCGI_STDIN, 0);
+    return out;
+}
+
+FastCGIRequest::FastCGIRequest(FastCGIPool::Backend* backend, unique_fd conn, bool reused, std::string request)
+    : backend_(backend), reused_(reused), request_(std::move(request)) {
+    fds_[STDOUT] = std::move(conn);
+    sending_ = true;
+    // 请求一般能一次写进socket缓冲区；写不下或出错时留给事件循环，fd就绪时继续发送或处理错误
+    send_();
+}
+
+void FastCGIRequest::onReady(Channel channel) {
+    if (channel != STDOUT || !fds_[STDOUT]) {
+        return;
+    }
+    if ((sending_ && !send_()) || !receive_()) {
+        fail_();
+    }
+}
+
+bool FastCGIRequest::send_() {
+    while (sent_ < request_.size()) {
+        ssize_t n = send(fds_[STDOUT].get(), request_.data() + sent_, request_.size() - sent_, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN;
+        }
+        sent_ += n;
+    }
+    sending_ = false;
+    return true;
+}
+
+bool FastCGIRequest::receive_() {
+    char buf[16384];
+    while (output_.readableBytes() < MAX_BUFFERED) {
+        ssize_t n = recv(fds_[STDOUT].get(), buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN;
+        }
+        if (n == 0) {
+            return false;  // 后端在FCGI_END_REQUEST之前关闭了连接
+        }
+        in_.append(buf, n);
+        if (parse_()) {
+            return true;
+        }
+    }
+    outputPaused_ = true;  // 连接上剩下的响应等已缓冲的输出被取走后再读
+    return true;
+}
+
+bool FastCGIRequest::parse_() {
+    size_t pos = 0;
+    while (in_.size() - pos >= HEADER_LEN) {
+        const uint8_t* h = reinterpret_cast<const uint8_t*>(in_.data() + pos);
+        const size_t contentLen = (h[4] << 8) | h[5];
+        const size_t recordLen = HEADER_LEN + contentLen + h[6];
+        if (in_.size() - pos < recordLen) {
+            break;
+        }
+        const char* content = in_.data() + pos + HEADER_LEN;
+        pos += recordLen;
+        if (((h[2] << 8) | h[3]) != REQUEST_ID) {
+            continue;
+        }
+        if (h[1] == FCGI_STDOUT) {
+            output_.append(content, contentLen);
+            replied_ = replied_ || contentLen > 0;
+        } else if (h[1] == FCGI_STDERR) {
+            std::cout << "FastCGI stderr: " << std::string_view(content, contentLen) << std::endl;
+        } else if (h[1] == FCGI_END_REQUEST) {
+            // 后端正常结束、请求已发完且没有多余数据时连接才能复用
+            const bool keep = contentLen >= 5 && static_cast<uint8_t>(content[4]) == FCGI_REQUEST_COMPLETE &&
+                              pos == in_.size() && !sending_;
+            unique_fd conn = std::move(fds_[STDOUT]);
+            if (keep) {
+                FastCGIPool::getInstance().release_(*backend_, std::move(conn));
+            }
+            finished_ = true;
+            std::string().swap(request_);
+            std::string().swap(in_);
+            return true;
+        }
+    }
+    in_.erase(0, pos);
+    return false;
+}
+
+void FastCGIRequest::fail_() {
+    // 空闲连接可能已被后端关闭，还没收到任何输出时换一条新连接重试一次，由事件循环等待新连接可写后重发
+    if (reused_ && !replied_) {
+        unique_fd conn = FastCGIPool::connect_(backend_->socketPath);
+        if (conn) {
+            fds_[STDOUT] = std::move(conn);
+            reused_ = false;
+            sending_ = true;
+            sent_ = 0;
+            in_.clear();
+            return;
+        }
+    }
+    std::cout << "FastCGI backend " << backend_->socketPath << " unavailable" << std::endl;
+    // 已经转发了部分输出时只能截断，否则代替后端输出502
+    if (!replied_) {
+        output_.append(FastCGIPool::BAD_GATEWAY);
+    }
+    fds_[STDOUT].reset();
+    finished_ = true;
+}
@@ -0,0 +1,92 @@
+#ifndef FASTCGI_CLIENT_H
+#define FASTCGI_CLIENT_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "cgi_process.h"
+#include "unique_fd.h"
+
+// FastCGI客户端：按请求路径前缀把CGI请求转发给常驻的本地应用进程（Unix socket）
+// 每个后端保留一组空闲连接（FCGI_KEEP_CONN），请求结束后归还复用，省去每次fork+exec和解释器启动
+class FastCGIPool {
+public:
+    static FastCGIPool& getInstance() {
+        static FastCGIPool instance;
+        return instance;
+    }
+
+    // 路径以prefix开头的请求转发到socketPath，有多个匹配时取最长前缀，须在处理请求之前配置
+    void addBackend(const std::string& prefix, const std::string& socketPath);
+
+    // 有匹配的后端时返回true：连上后端后把请求交给*async，由事件循环驱动收发，输出为CGI格式（响应头+空行+内容）；
+    // 连不上后端时*async为空。没有匹配的后端时返回false
+    bool start(std::string_view path, const std::unordered_map<std::string, std::string>& env,
+               std::string_view body, std::unique_ptr<CgiProcess>* async);
+
+    // 后端不可用时代替后端输出的CGI格式响应
+    static constexpr std::string_view BAD_GATEWAY =
+        "Status: 502 Bad Gateway\r\nContent-Type: text/html\r\n\r\n"
+        "<html><body><h1>502 - FastCGI Backend Error</h1></body></html>";
+
+private:
+    friend class FastCGIRequest;
+
+    FastCGIPool() = default;
+
+    FastCGIPool(const FastCGIPool&) = delete;
+    FastCGIPool& operator=(const FastCGIPool&) = delete;
+
+    static const size_t MAX_IDLE_PER_BACKEND = 16;
+
+    struct Backend {
+        std::string prefix;
+        std::string socketPath;
+        std::mutex mtx;
+        std::vector<unique_fd> idle;  // 空闲连接，后进先出
+    };
+
+    Backend* match_(std::string_view path) const;
+    unique_fd acquire_(Backend& backend, bool* reused);
+    void release_(Backend& backend, unique_fd conn);
+
+    static unique_fd connect_(const std::string& socketPath);
+    // 一次请求的全部记录：FCGI_BEGIN_REQUEST、参数流和请求体流
+    static std::string buildRequest_(const std::unordered_map<std::string, std::string>& env, std::string_view body);
+
+    std::vector<std::unique_ptr<Backend>> backends_;
+};
+
+// 转发给FastCGI后端的一个请求：连接是非阻塞的，与CGI子进程一样登记在事件循环中，只用stdout通道
+// 请求记录没发完时同时等待可写，FCGI_STDOUT的内容读入output()，收到FCGI_END_REQUEST后完成并归还连接
+// 后端卡住时不占用线程，由连接的超时定时器关闭连接
+class FastCGIRequest : public CgiProcess {
+public:
+    FastCGIRequest(FastCGIPool::Backend* backend, unique_fd conn, bool reused, std::string request);
+
+    void onReady(Channel channel) override;
+
+private:
+    bool send_();
+    bool receive_();
+    // 处理in_中已收全的记录，收到FCGI_END_REQUEST时完成请求并返回true
+    bool parse_();
+    void fail_();
+
+    FastCGIPool::Backend* backend_;
+    bool reused_;
+    bool replied_ = false;  // 收到过FCGI_STDOUT内容
+    std::string request_;   // 重试时需要重发，完成前一直保留
+    size_t sent_ = 0;
+    std::string in_;
+};
+
+inline void addFastCGIBackend(const std::string& prefix, const std::string& socketPath) {
+    FastCGIPool::getInstance().addBackend(prefix, socketPath);
+}
+
+#endif  // FASTCGI_CLIENT_H
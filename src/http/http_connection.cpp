@@ -1,5 +1,10 @@
 #include "http_connection.h"
 
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+#include <charconv>
+
 const char* HTTPconnection::srcDir;
 std::atomic<int> HTTPconnection::userCount;
 bool HTTPconnection::isET;
@@ -8,6 +13,12 @@ HTTPconnection::HTTPconnection() {
     fd_ = -1;
     addr_ = {0};
     isClose_ = true;
+    pendingCnt_ = 0;
+    iovCnt_ = iovIdx_ = 0;
+    writeBytes_ = 0;
+    keepAlive_ = false;
+    cgiStarted_ = false;
+    cgiHeadSent_ = cgiChunked_ = cgiKeepAlive_ = false;
 };
 
 HTTPconnection::~HTTPconnection() {
@@ -21,11 +32,27 @@ void HTTPconnection::initHTTPConn(int fd, const sockaddr_in& addr) {
     fd_ = fd;
     writeBuffer_.initPtr();
     readBuffer_.initPtr();
+    request_.init();
+    pendingCnt_ = 0;
+    iovCnt_ = iovIdx_ = 0;
+    writeBytes_ = 0;
+    keepAlive_ = false;
+    cgi_.reset();
+    cgiStarted_ = false;
     isClose_ = false;
 }
 
 void HTTPconnection::closeHTTPConn() {
     response_.unmapFile_();
+    // 连接对象留在连接表中复用，关闭时归还缓冲区
+    // io_uring的writev在途时事件循环已先用detachPendingWrite取走它引用的部分
+    readBuffer_.release();
+    writeBuffer_.release();
+    releaseFiles_();
+    writeBytes_ = 0;
+    // 连接先于子进程结束时终止子进程，关闭管道和pidfd的同时也从事件循环中移除
+    cgi_.reset();
+    cgiStarted_ = false;
     if (isClose_ == false) {
         isClose_ = true;
         userCount--;
@@ -33,6 +60,14 @@ void HTTPconnection::closeHTTPConn() {
     }
 }
 
+CgiProcess* HTTPconnection::startedCgi() {
+    if (!cgiStarted_) {
+        return nullptr;
+    }
+    cgiStarted_ = false;
+    return cgi_.get();
+}
+
 int HTTPconnection::getFd() const {
     return fd_;
 };
@@ -61,27 +96,14 @@ ssize_t HTTPconnection::writeBuffer(int* saveErrno) {
     ssize_t len = -1;
     ssize_t total = 0;
     do {
-        len = writev(fd_, iov_, iovCnt_);
+        len = fileRange_[iovIdx_].fd >= 0 ? sendFile_() : sendIov_();
         if (len <= 0) {
-            *saveErrno = errno;
+            // sendfile返回0说明文件在发送过程中被截短，已声明的Content-length无法补齐
+            *saveErrno = len == 0 ? EIO : errno;
             break;
         }
         total += len;
-        if (iov_[0].iov_len + iov_[1].iov_len == 0) {
-            break;
-        }
-        else if (static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base = (uint8_t*)iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if (iov_[0].iov_len) {
-                writeBuffer_.initPtr();
-                iov_[0].iov_len = 0;
-            }
-        } else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len;
-            iov_[0].iov_len -= len;
-            writeBuffer_.updateReadPtr(len);
-        }
+        consumeWritten(len);
         if (!isET || total > 65536) {
             break;
         }
@@ -89,52 +111,276 @@ ssize_t HTTPconnection::writeBuffer(int* saveErrno) {
     return total > 0 ? total : len;
 }
 
+ssize_t HTTPconnection::sendIov_() {
+    // 一次发到下一个文件段为止；后面紧跟文件时带MSG_MORE，响应头与文件的第一块合并发出
+    int end = iovIdx_;
+    while (end < iovCnt_ && fileRange_[end].fd < 0) {
+        ++end;
+    }
+    struct msghdr msg = {};
+    msg.msg_iov = iov_ + iovIdx_;
+    msg.msg_iovlen = end - iovIdx_;
+    return sendmsg(fd_, &msg, end < iovCnt_ ? MSG_MORE : 0);
+}
+
+ssize_t HTTPconnection::sendFile_() {
+    // 偏移只由consumeWritten推进，sendfile改的是局部副本
+    off_t offset = fileRange_[iovIdx_].offset;
+    return sendfile(fd_, fileRange_[iovIdx_].fd, &offset, iov_[iovIdx_].iov_len);
+}
+
+void HTTPconnection::appendReadBuffer(const char* data, size_t len) {
+    readBuffer_.append(data, len);
+}
+
+const struct iovec* HTTPconnection::writeIov(int* cnt) const {
+    // io_uring后端不设映射上限，不会出现sendfile段
+    *cnt = iovCnt_ - iovIdx_;
+    return iov_ + iovIdx_;
+}
+
+void HTTPconnection::consumeWritten(size_t len) {
+    assert(len <= writeBytes_);
+    writeBytes_ -= len;
+    while (len > 0) {
+        struct iovec& iov = iov_[iovIdx_];
+        size_t n = len < iov.iov_len ? len : iov.iov_len;
+        if (fileRange_[iovIdx_].fd >= 0) {
+            fileRange_[iovIdx_].offset += n;
+        } else {
+            iov.iov_base = (uint8_t*)iov.iov_base + n;
+        }
+        iov.iov_len -= n;
+        len -= n;
+        if (iov.iov_len == 0) {
+            ++iovIdx_;
+        }
+    }
+    if (writeBytes_ == 0) {
+        // 整批响应写完，把写缓冲区的块还给块池并释放对缓存文件的引用
+        writeBuffer_.release();
+        releaseFiles_();
+    }
+}
+
+std::unique_ptr<HTTPconnection::PendingWrite> HTTPconnection::detachPendingWrite() {
+    auto pending = std::make_unique<PendingWrite>();
+    pending->buffer = std::move(writeBuffer_);
+    for (int i = 0; i < pendingCnt_; ++i) {
+        pending->files[i] = std::move(files_[i]);
+    }
+    releaseFiles_();
+    writeBytes_ = 0;
+    return pending;
+}
+
+void HTTPconnection::releaseFiles_() {
+    for (int i = 0; i < pendingCnt_; ++i) {
+        files_[i].reset();
+    }
+    pendingCnt_ = 0;
+    iovCnt_ = iovIdx_ = 0;
+}
+
+// 解析读缓冲区中已完整到达的所有请求（最多MAX_PIPELINE个），响应依次追加到写端
+// 有响应待发送时返回true，调用方随后用一次writev发出整批响应
 bool HTTPconnection::handleHTTPConn() {
-    request_.init();
-    if (readBuffer_.readableBytes() <= 0) {
+    if (writeBytes_ > 0) {
+        return false;  // 上一批还没写完，写完后由写回调继续处理，保证响应顺序
+    }
+    releaseFiles_();
+    writeBuffer_.initPtr();
+    if (cgi_) {
+        return streamCgi_();
+    }
+    keepAlive_ = true;
+    while (pendingCnt_ < MAX_PIPELINE && iovCnt_ + 2 * HTTPresponse::MAX_RANGES + 1 <= MAX_SEGMENTS &&
+           keepAlive_ && readBuffer_.readableBytes() > 0) {
+        if (!processRequest_()) {
+            break;
+        }
+    }
+    if (pendingCnt_ == 0) {
+        // 连接进入空闲（等待下一个请求或剩余的请求数据），缓冲区按空闲策略收缩
+        readBuffer_.shrink();
+        writeBuffer_.release();
         return false;
-    } else if (request_.parse(readBuffer_)) {
-        // 检查是否是CGI请求 - 避免路径拷贝
-        const std::string& request_path = request_.path_ref();
-        if (request_path.find("/cgi-bin/") == 0) {
-            // 处理CGI请求
-            std::string queryString = "";
-            
+    }
+    buildIov_();
+    return true;
+}
+
+bool HTTPconnection::processRequest_() {
+    // CGI请求只能作为一批中的第一个请求异步启动：排在其他响应之后时先结束这一批，
+    // 等前面的响应写完后由下一批处理，事件循环线程不等待子进程
+    if (pendingCnt_ > 0 && HTTPrequest::peekTarget(readBuffer_).compare(0, 9, "/cgi-bin/") == 0) {
+        return false;
+    }
+    const size_t bufStart = writeBuffer_.readableBytes();
+    if (request_.parse(readBuffer_)) {
+        // 检查是否是CGI请求，路径和查询串都是读缓冲区上的视图
+        std::string_view request_path = request_.path();
+        if (request_path.compare(0, 9, "/cgi-bin/") == 0) {
             // 分离路径和查询字符串
+            std::string_view queryString;
             size_t queryPos = request_path.find('?');
-            std::string path_str;
-            if (queryPos != std::string::npos) {
-                queryString = std::string(request_path.substr(queryPos + 1));
-                path_str = std::string(request_path.substr(0, queryPos));
-            } else {
-                path_str = std::string(request_path);
+            if (queryPos != std::string_view::npos) {
+                queryString = request_path.substr(queryPos + 1);
+                request_path = request_path.substr(0, queryPos);
             }
             
-            response_.init(srcDir, path_str, request_.isKeepAlive(), 200);
-            response_.makeCGIResponse(writeBuffer_, request_.method(), request_.getBody(), queryString);
+            response_.init(srcDir, request_path, request_.isKeepAlive(), 200);
+            // 脚本以子进程异步执行，它的输出由之后的批次转发；
+            // 出错时同步写入的响应声明了Connection: close，结束这一批
+            response_.makeCGIResponse(writeBuffer_, request_.method(), request_.getBody(), queryString, &cgi_);
             
-            // CGI响应不需要文件处理
-            iov_[0].iov_base = const_cast<char*>(writeBuffer_.curReadPtr());
-            iov_[0].iov_len = writeBuffer_.readableBytes();
-            iovCnt_ = 1;
+            // 子进程单独占用连接，输出转发完之前不再处理后续请求
+            keepAlive_ = false;
+            if (cgi_) {
+                cgiStarted_ = true;
+                cgiHeadSent_ = false;
+                cgiChunked_ = request_.version() == "1.1";
+                cgiKeepAlive_ = request_.isKeepAlive();
+                return true;
+            }
+            pushSegment_(nullptr, writeBuffer_.readableBytes() - bufStart);
+            files_[pendingCnt_++] = nullptr;
             return true;
         } else {
-            // 处理普通HTML请求 - 直接使用string_view
+            // 处理普通HTML请求
             response_.init(srcDir, request_path, request_.isKeepAlive(), 200);
+            if (request_.method() == "GET") {
+                response_.setRange(request_.range(), request_.ifRange());
+                response_.setValidators(request_.ifNoneMatch(), request_.ifModifiedSince());
+                response_.setAcceptEncoding(request_.acceptEncoding());
+            }
+            keepAlive_ = request_.isKeepAlive();
         }
+    } else if (request_.isIncomplete()) {
+        return false;  // 等待剩余的请求头或请求体，解析进度保留在request_中
     } else {
         response_.init(srcDir, request_.path(), false, 400);
+        keepAlive_ = false;
     }
 
     response_.makeResponse(writeBuffer_);
-    iov_[0].iov_base = const_cast<char*>(writeBuffer_.curReadPtr());
-    iov_[0].iov_len = writeBuffer_.readableBytes();
-    iovCnt_ = 1;
+    const PrebuiltResponse* pre = response_.prebuilt();
+    // 连接持有文件引用直到整批写完，缓存失效不影响正在发送的内容
+    std::shared_ptr<const CachedFile>& file = files_[pendingCnt_++];
+    file = response_.releaseFile();
+    if (pre) {
+        // 预构建响应：[Date之前][写缓冲区中的Date][Date之后+文件内容]
+        pushSegment_(pre->block.data(), pre->headLen);
+        pushSegment_(nullptr, writeBuffer_.readableBytes() - bufStart);
+        pushSegment_(pre->block.data() + pre->headLen, pre->block.size() - pre->headLen);
+    } else if (response_.rangeCount() > 0) {
+        // 206响应：写缓冲区中的头部与各段文件内容交替
+        size_t pos = bufStart;
+        for (int i = 0; i < response_.rangeCount(); ++i) {
+            const HTTPresponse::ByteRange& r = response_.range(i);
+            pushSegment_(nullptr, r.bufPos - pos);
+            pushFile_(*file, r.first, r.len);
+            pos = r.bufPos;
+        }
+        pushSegment_(nullptr, writeBuffer_.readableBytes() - pos);
+    } else {
+        pushSegment_(nullptr, writeBuffer_.readableBytes() - bufStart);
+        if (file) {
+            pushFile_(*file, 0, file->size);
+        }
+    }
+    return true;
+}
 
-    if (response_.fileLen() > 0 && response_.file()) {
-        iov_[1].iov_base = response_.file();
-        iov_[1].iov_len = response_.fileLen();
-        iovCnt_ = 2;
+// 把子进程已有的输出发给客户端：响应头块收全后先发响应头，之后每次把新读到的输出作为一个chunk发送，
+// 子进程结束后以结束块收尾；运行期间没有新输出时返回false
+bool HTTPconnection::streamCgi_() {
+    Buffer& output = cgi_->output();
+    if (!cgiHeadSent_ && cgi_->finished()) {
+        // 还没开始转发子进程就结束了，整理成带Content-Length的普通响应
+        CGIHandler::writeResponse(output.view(), writeBuffer_);
+        cgi_.reset();
+        keepAlive_ = false;
+    } else {
+        if (!cgiHeadSent_) {
+            bool hasLength = false;
+            long head = CGIHandler::writeHead(output.view(), false, writeBuffer_, &hasLength);
+            // 脚本给出了Content-Length或客户端不支持chunked时原样转发，以关闭连接结束；
+            // 原样转发总是留下最后一个字节到子进程结束时再发，保证最后一批不为空，写完即关闭连接
+            const bool chunked = cgiChunked_ && !hasLength;
+            if (head < 0 || (!chunked && output.readableBytes() - head < 2)) {
+                writeBuffer_.initPtr();
+                return false;
+            }
+            output.updateReadPtr(head);
+            cgiChunked_ = chunked;
+            cgiKeepAlive_ = cgiKeepAlive_ && cgiChunked_;
+            writeBuffer_.appendAll(cgiChunked_ ? "Transfer-Encoding: chunked\r\n" : "",
+                                   cgiKeepAlive_ ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+            cgiHeadSent_ = true;
+        }
+        size_t len = output.readableBytes();
+        if (!cgiChunked_ && !cgi_->finished() && len > 0) {
+            --len;
+        }
+        const std::string_view data(output.curReadPtr(), len);
+        if (len > 0 && cgiChunked_) {
+            char size[16];
+            std::string_view hex(size, std::to_chars(size, size + sizeof(size), len, 16).ptr - size);
+            writeBuffer_.appendAll(hex, "\r\n", data, "\r\n");
+        } else {
+            writeBuffer_.append(data);
+        }
+        output.updateReadPtr(len);
+        // 写完这一批后由写回调再次进入，继续转发之后的输出
+        keepAlive_ = true;
+        if (cgi_->finished()) {
+            if (cgiChunked_) {
+                writeBuffer_.append("0\r\n\r\n");
+            }
+            cgi_.reset();
+            keepAlive_ = cgiKeepAlive_;
+        }
+    }
+    if (writeBuffer_.readableBytes() == 0) {
+        return false;
     }
+    files_[pendingCnt_++] = nullptr;
+    pushSegment_(nullptr, writeBuffer_.readableBytes());
+    buildIov_();
     return true;
-}
\ No newline at end of file
+}
+
+void HTTPconnection::pushSegment_(const char* mem, size_t len, int fd, off_t offset) {
+    if (len == 0) {
+        return;
+    }
+    if (!mem && fd < 0 && iovCnt_ > 0 && !iov_[iovCnt_ - 1].iov_base && fileRange_[iovCnt_ - 1].fd < 0) {
+        iov_[iovCnt_ - 1].iov_len += len;  // 相邻的写缓冲区段合并
+    } else {
+        assert(iovCnt_ < MAX_SEGMENTS);
+        iov_[iovCnt_] = {const_cast<char*>(mem), len};
+        fileRange_[iovCnt_++] = {fd, offset};
+    }
+    writeBytes_ += len;
+}
+
+void HTTPconnection::pushFile_(const CachedFile& file, size_t first, size_t len) {
+    // 映射过的文件直接引用内存，大文件没有映射，用sendfile从偏移处发送
+    if (file.data) {
+        pushSegment_(file.data + first, len);
+    } else {
+        pushSegment_(nullptr, len, file.fd.get(), first);
+    }
+}
+
+void HTTPconnection::buildIov_() {
+    // 写缓冲区在整批响应生成完后才确定地址，此时再给写缓冲区段填入地址
+    char* base = const_cast<char*>(writeBuffer_.curReadPtr());
+    for (int i = 0; i < iovCnt_; ++i) {
+        if (!iov_[i].iov_base && fileRange_[i].fd < 0) {
+            iov_[i].iov_base = base;
+            base += iov_[i].iov_len;
+        }
+    }
+}
@@ -6,10 +6,13 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <atomic>
+#include <memory>
 
 #include "http_request.h"
 #include "http_response.h"
 #include "buffer.h"
+#include "cgi_process.h"
+#include "timer.h"
 
 class HTTPconnection {
 public:
@@ -21,37 +24,111 @@ public:
     ssize_t readBuffer(int* saveErrno);
     ssize_t writeBuffer(int* saveErrno);
 
+    // io_uring后端：由内核完成I/O，连接只负责搬运数据与推进写位置
+    void appendReadBuffer(const char* data, size_t len);
+    const struct iovec* writeIov(int* cnt) const;
+    void consumeWritten(size_t len);
+
     void closeHTTPConn();
     bool handleHTTPConn();
 
     int getFd() const;
     struct sockaddr_in getAddr() const;
 
-    int writeBytes() {
-        return iov_[1].iov_len + iov_[0].iov_len;
+    size_t writeBytes() const {
+        return writeBytes_;
     }
 
+    // 当前这批响应写完后是否保持连接
     bool isKeepAlive() const {
-        return request_.isKeepAlive();
+        return keepAlive_;
+    }
+
+    bool isClosed() const {
+        return isClose_;
+    }
+
+    // 正在转发输出的CGI子进程，没有时为nullptr；所属事件循环在它的fd就绪时调用onReady，
+    // 没有未写完的数据时再次调用handleHTTPConn把新的输出发给客户端
+    CgiProcess* cgi() const {
+        return cgi_.get();
+    }
+    // 本次handleHTTPConn刚启动的子进程，每个子进程只返回一次，事件循环据此登记它的fd
+    CgiProcess* startedCgi();
+    // 有刚启动、还没被startedCgi取走的子进程
+    bool hasStartedCgi() const {
+        return cgiStarted_;
+    }
+
+    // 嵌入的超时定时器节点，由所属事件循环的TimerManager管理
+    TimerNode* timerNode() {
+        return &timerNode_;
     }
 
     static bool isET;
     static const char* srcDir;
     static std::atomic<int> userCount;
 
+    static const int MAX_PIPELINE = 16;  // 一批最多合并的流水线请求数
+    // 一批响应最多的发送段数：普通响应不超过3段，多段Range响应为2*MAX_RANGES+1段
+    static const int MAX_SEGMENTS = 3 * MAX_PIPELINE + 2 * HTTPresponse::MAX_RANGES;
+    // 超过该大小的文件不映射，由writeBuffer用sendfile从fd发送（仅epoll后端）
+    static const size_t SENDFILE_THRESHOLD = 128 * 1024;
+
+    // 未写完的一批响应占用的写缓冲区和文件引用（映射、预构建响应都属于文件）
+    struct PendingWrite {
+        Buffer buffer;
+        std::shared_ptr<const CachedFile> files[MAX_PIPELINE];
+    };
+    // 交出未写完的这一批，连接不再引用它们：关闭时writev仍在途，由事件循环保存到完成事件到达后再释放
+    std::unique_ptr<PendingWrite> detachPendingWrite();
+
 private:
+    // 与iov_一一对应，fd>=0的段没有内存地址，从文件的offset处sendfile，
+    // 偏移随写入推进，跨多次EPOLLOUT保持
+    // 生成响应期间iov_base为空且fd<0的段是写缓冲区中的字节，整批生成完后由buildIov_填入地址
+    struct FileRange {
+        int fd;
+        off_t offset;
+    };
+
+    bool processRequest_();
+    bool streamCgi_();
+    void pushSegment_(const char* mem, size_t len, int fd = -1, off_t offset = 0);
+    void pushFile_(const CachedFile& file, size_t first, size_t len);
+    void buildIov_();
+    void releaseFiles_();
+    ssize_t sendIov_();
+    ssize_t sendFile_();
+
     int fd_;
     struct sockaddr_in addr_;
     bool isClose_;
 
+    // 本批每个响应持有的文件引用，保证映射和fd在整批写完前有效
+    std::shared_ptr<const CachedFile> files_[MAX_PIPELINE];
+    int pendingCnt_;
+
     int iovCnt_;
-    struct iovec iov_[2];
+    int iovIdx_;  // 第一个尚未写完的iovec
+    struct iovec iov_[MAX_SEGMENTS];
+    FileRange fileRange_[MAX_SEGMENTS];
+    size_t writeBytes_;
+    bool keepAlive_;
 
     Buffer readBuffer_;
     Buffer writeBuffer_;
 
     HTTPrequest request_;
     HTTPresponse response_;
+
+    std::unique_ptr<CgiProcess> cgi_;
+    bool cgiStarted_;
+    bool cgiHeadSent_;
+    bool cgiChunked_;    // 以chunked编码转发内容，否则原样转发并在结束后关闭连接
+    bool cgiKeepAlive_;  // 子进程结束后连接是否保持
+
+    TimerNode timerNode_;
 };
 
 #endif  // HTTP_CONNECTION_H
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "http_parser.h"
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+const char* HTTPparser::findAny_(const char* p, const char* end, const char* set, size_t setLen) {
+#if defined(__AVX2__)
+    __m256i needles[4];
+    for (size_t i = 0; i < setLen; ++i) {
+        needles[i] = _mm256_set1_epi8(set[i]);
+    }
+    while (end - p >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_cmpeq_epi8(block, needles[0]);
+        for (size_t i = 1; i < setLen; ++i) {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, needles[i]));
+        }
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#elif defined(__SSE4_2__)
+    // PCMPESTRI的EQUAL_ANY模式一条指令完成16字节对字符集合的匹配
+    char setBuf[16] = {0};
+    for (size_t i = 0; i < setLen; ++i) {
+        setBuf[i] = set[i];
+    }
+    const __m128i needles = _mm_loadu_si128(reinterpret_cast<const __m128i*>(setBuf));
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int idx = _mm_cmpestri(needles, static_cast<int>(setLen), block, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16) {
+            return p + idx;
+        }
+        p += 16;
+    }
+#endif
+    // 标量处理剩余不足一个块的字节
+    for (; p < end; ++p) {
+        for (size_t i = 0; i < setLen; ++i) {
+            if (*p == set[i]) {
+                return p;
+            }
+        }
+    }
+    return end;
+}
+
+int HTTPparser::skipEol_(const char*& p, const char* end) {
+    if (*p == '\r') {
+        if (p + 1 == end) {
+            return PARSE_INCOMPLETE;
+        }
+        if (p[1] != '\n') {
+            return PARSE_ERROR;
+        }
+        p += 2;
+        return 0;
+    }
+    if (*p == '\n') {
+        ++p;
+        return 0;
+    }
+    return PARSE_ERROR;
+}
+
+int HTTPparser::findHeaderEnd(const char* buf, size_t len, size_t* scanned) {
+    const char* end = buf + len;
+    const char* p = buf + *scanned;
+    for (;;) {
+        const char* lf = findAny_(p, end, "\n", 1);
+        if (lf == end) {
+            *scanned = len;
+            return PARSE_INCOMPLETE;
+        }
+        // LF之后紧跟LF或CRLF即为空行
+        const char* next = lf + 1;
+        if (next == end || (*next == '\r' && next + 1 == end)) {
+            *scanned = lf - buf;  // 下次从这个LF重新判断
+            return PARSE_INCOMPLETE;
+        }
+        if (*next == '\n') {
+            return static_cast<int>(next + 1 - buf);
+        }
+        if (*next == '\r' && next[1] == '\n') {
+            return static_cast<int>(next + 2 - buf);
+        }
+        p = next;
+    }
+}
+
+int HTTPparser::parseRequest(const char* buf, size_t len, RequestSpans* req) {
+    const char* p = buf;
+    const char* end = buf + len;
+    int ret = 0;
+    req->numHeaders = 0;
+
+    // 请求行：METHOD SP PATH SP HTTP/VERSION CRLF
+    const char* sp = findAny_(p, end, " \r\n", 3);
+    if (sp == end) {
+        return PARSE_INCOMPLETE;
+    }
+    if (*sp != ' ' || sp == p) {
+        return PARSE_ERROR;
+    }
+    req->method = std::string_view(p, sp - p);
+    p = sp + 1;
+
+    sp = findAny_(p, end, " \r\n", 3);
+    if (sp == end) {
+        return PARSE_INCOMPLETE;
+    }
+    if (*sp != ' ' || sp == p) {
+        return PARSE_ERROR;
+    }
+    req->path = std::string_view(p, sp - p);
+    p = sp + 1;
+
+    const char* eol = findAny_(p, end, "\r\n", 2);
+    if (eol == end) {
+        return PARSE_INCOMPLETE;
+    }
+    std::string_view version(p, eol - p);
+    if (version.size() <= 5 || version.substr(0, 5) != "HTTP/") {
+        return PARSE_ERROR;
+    }
+    req->version = version.substr(5);
+    p = eol;
+    if ((ret = skipEol_(p, end)) != 0) {
+        return ret;
+    }
+
+    // 请求头：NAME ":" OWS VALUE OWS CRLF，直到空行
+    for (;;) {
+        if (p == end) {
+            return PARSE_INCOMPLETE;
+        }
+        if (*p == '\r' || *p == '\n') {
+            if ((ret = skipEol_(p, end)) != 0) {
+                return ret;
+            }
+            return static_cast<int>(p - buf);
+        }
+        if (req->numHeaders == RequestSpans::MAX_HEADERS) {
+            return PARSE_ERROR;
+        }
+
+        const char* colon = findAny_(p, end, ":\r\n", 3);
+        if (colon == end) {
+            return PARSE_INCOMPLETE;
+        }
+        if (*colon != ':' || colon == p) {
+            return PARSE_ERROR;
+        }
+        HeaderSpan& header = req->headers[req->numHeaders];
+        header.name = std::string_view(p, colon - p);
+
+        const char* value = colon + 1;
+        eol = findAny_(value, end, "\r\n", 2);
+        if (eol == end) {
+            return PARSE_INCOMPLETE;
+        }
+        const char* valueEnd = eol;
+        while (value < valueEnd && (*value == ' ' || *value == '\t')) {
+            ++value;
+        }
+        while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+            --valueEnd;
+        }
+        header.value = std::string_view(value, valueEnd - value);
+        ++req->numHeaders;
+
+        p = eol;
+        if ((ret = skipEol_(p, end)) != 0) {
+            return ret;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+
+#include <string_view>
+
+// 请求头中的一个字段，name/value均指向原始缓冲区
+struct HeaderSpan {
+    std::string_view name;
+    std::string_view value;
+};
+
+// 一次解析得到的请求行和请求头，全部为指向输入缓冲区的视图
+struct RequestSpans {
+    static const size_t MAX_HEADERS = 64;
+
+    std::string_view method;
+    std::string_view path;
+    std::string_view version;  // 不含"HTTP/"前缀，如"1.1"
+    HeaderSpan headers[MAX_HEADERS];
+    size_t numHeaders;
+};
+
+// 单遍扫描的HTTP/1.1请求头解析器（思路来自picohttpparser）
+// 按16/32字节块向量化查找CR/LF/冒号/空格，支持AVX2、SSE4.2，其他平台逐字节扫描
+class HTTPparser {
+public:
+    static const int PARSE_ERROR = -1;
+    static const int PARSE_INCOMPLETE = -2;
+
+    // 成功返回请求头总长度（含结尾空行），格式错误返回PARSE_ERROR，数据不完整返回PARSE_INCOMPLETE
+    static int parseRequest(const char* buf, size_t len, RequestSpans* req);
+
+    // 增量查找请求头结尾的空行：从*scanned处继续扫描，已扫描的字节不再重复检查
+    // 找到时返回请求头总长度，否则返回PARSE_INCOMPLETE并更新*scanned
+    static int findHeaderEnd(const char* buf, size_t len, size_t* scanned);
+
+private:
+    // 在[p, end)中查找第一个属于set的字节（set最多4个字符），找不到返回end
+    static const char* findAny_(const char* p, const char* end, const char* set, size_t setLen);
+    // p指向行尾的CR或LF，跳过CRLF（或单独的LF）后指向下一行，成功返回0
+    static int skipEol_(const char*& p, const char* end);
+};
+
+#endif  // HTTP_PARSER_H
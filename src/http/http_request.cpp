@@ -1,197 +1,259 @@
 #include "http_request.h"
-#include <algorithm>  // 添加std::search支持
+#include <algorithm>
+#include <charconv>
 
 void HTTPrequest::init() {
-    method_ = path_ = version_ = body_ = "";
     state_ = REQUEST_LINE;
-    header_.clear();
-    post_.clear();
+    incomplete_ = false;
+    scanned_ = 0;
+    headerLen_ = 0;
+    base_ = nullptr;
+    spans_.method = spans_.path = spans_.version = std::string_view();
+    spans_.numHeaders = 0;
+    body_ = host_ = contentType_ = std::string_view();
+    range_ = ifRange_ = ifNoneMatch_ = ifModifiedSince_ = acceptEncoding_ = std::string_view();
+    contentLength_ = 0;
+    keepAlive_ = false;
 }
 
 bool HTTPrequest::isKeepAlive() const {
-    auto it = header_.find("Connection");
-    if (it != header_.end()) {
-        return it->second == "keep-alive" && version_ == "1.1";
+    return keepAlive_;
+}
+
+std::string_view HTTPrequest::peekTarget(const Buffer& buff) {
+    std::string_view line(buff.curReadPtr(), std::min(buff.readableBytes(), MAX_HEADER_SIZE));
+    size_t start = line.find(' ');
+    if (start == std::string_view::npos) {
+        return std::string_view();
     }
-    return false;
+    size_t end = line.find_first_of(" \r\n", start + 1);
+    if (end == std::string_view::npos) {
+        return std::string_view();
+    }
+    return line.substr(start + 1, end - start - 1);
 }
 
+// 可恢复的解析状态机：请求未收全时保留进度并返回false（isIncomplete()为true）
+// 请求头和请求体都收全之前不移动读指针，因此缓冲区扩容或搬移后只需平移已有的视图
 bool HTTPrequest::parse(Buffer& buff) {
-    const char CRLF[] = "\r\n";
-    if (buff.readableBytes() <= 0) {
-        return false;
+    if (state_ == FINISH) {
+        init();  // 上一个请求已经完成，开始解析下一个
     }
-    while (buff.readableBytes() && state_ != FINISH) {
-        const char* lineEnd =
-            std::search(buff.curReadPtr(), buff.curWritePtrConst(), CRLF, CRLF + 2);
-        std::string_view line(buff.curReadPtr(), lineEnd - buff.curReadPtr());
-        switch (state_) {
-            case REQUEST_LINE:
-                if (!parseRequestLine_(line)) {
-                    return false;
-                }
-                parsePath_();
+    incomplete_ = false;
+    const char* begin = buff.curReadPtr();
+    const size_t readable = buff.readableBytes();
+
+    if (state_ == REQUEST_LINE) {
+        // 只扫描新到达的字节寻找空行，找到后再对完整的请求头做一次解析
+        int headerLen = HTTPparser::findHeaderEnd(begin, readable, &scanned_);
+        if (headerLen == HTTPparser::PARSE_INCOMPLETE) {
+            incomplete_ = readable < MAX_HEADER_SIZE;
+            return false;
+        }
+        if (HTTPparser::parseRequest(begin, headerLen, &spans_) != headerLen) {
+            return false;
+        }
+        resolveHeaders_();
+        if (contentLength_ > MAX_BODY_SIZE) {
+            return false;
+        }
+        headerLen_ = headerLen;
+        base_ = begin;
+        state_ = BODY;
+    }
+
+    if (state_ == BODY) {
+        if (begin != base_) {
+            rebase_(begin);
+        }
+        // 按Content-Length等待完整的请求体
+        if (readable - headerLen_ < contentLength_) {
+            incomplete_ = true;
+            return false;
+        }
+        body_ = std::string_view(begin + headerLen_, contentLength_);
+        parsePath_();
+        // 只移动读指针，数据保留到下一次读入，视图在生成响应期间仍然有效
+        buff.updateReadPtr(headerLen_ + contentLength_);
+        state_ = FINISH;
+    }
+    return true;
+}
+
+void HTTPrequest::rebase_(const char* base) {
+    // 读缓冲区在等待请求体期间发生了搬移，请求头视图跟随平移
+    auto shift = [this, base](std::string_view& v) {
+        if (v.data() == nullptr) {
+            return;
+        }
+        v = std::string_view(base + (v.data() - base_), v.size());
+    };
+    shift(spans_.method);
+    shift(spans_.path);
+    shift(spans_.version);
+    for (size_t i = 0; i < spans_.numHeaders; ++i) {
+        shift(spans_.headers[i].name);
+        shift(spans_.headers[i].value);
+    }
+    shift(host_);
+    shift(contentType_);
+    shift(range_);
+    shift(ifRange_);
+    shift(ifNoneMatch_);
+    shift(ifModifiedSince_);
+    shift(acceptEncoding_);
+    base_ = base;
+}
+
+void HTTPrequest::resolveHeaders_() {
+    std::string_view connection;
+    for (size_t i = 0; i < spans_.numHeaders; ++i) {
+        const HeaderSpan& h = spans_.headers[i];
+        // 先按长度分派，只对可能命中的字段做比较
+        switch (h.name.size()) {
+            case 4:
+                if (equalsIgnoreCase_(h.name, "Host")) host_ = h.value;
+                break;
+            case 5:
+                if (equalsIgnoreCase_(h.name, "Range")) range_ = h.value;
                 break;
-            case HEADERS:
-                parseRequestHeader_(line);
-                if (buff.readableBytes() <= 2) {
-                    state_ = FINISH;
+            case 8:
+                if (equalsIgnoreCase_(h.name, "If-Range")) ifRange_ = h.value;
+                break;
+            case 10:
+                if (equalsIgnoreCase_(h.name, "Connection")) connection = h.value;
+                break;
+            case 12:
+                if (equalsIgnoreCase_(h.name, "Content-Type")) contentType_ = h.value;
+                break;
+            case 13:
+                if (equalsIgnoreCase_(h.name, "If-None-Match")) ifNoneMatch_ = h.value;
+                break;
+            case 14:
+                if (equalsIgnoreCase_(h.name, "Content-Length")) {
+                    std::from_chars(h.value.data(), h.value.data() + h.value.size(), contentLength_);
                 }
                 break;
-            case BODY:
-                parseDataBody_(line);
+            case 15:
+                if (equalsIgnoreCase_(h.name, "Accept-Encoding")) acceptEncoding_ = h.value;
+                break;
+            case 17:
+                if (equalsIgnoreCase_(h.name, "If-Modified-Since")) ifModifiedSince_ = h.value;
                 break;
             default:
                 break;
         }
-        if (lineEnd == buff.curWritePtr()) {
-            break;
+    }
+    keepAlive_ = connection == "keep-alive" && spans_.version == "1.1";
+}
+
+bool HTTPrequest::equalsIgnoreCase_(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        // 只用于比较字段名，ASCII字母与0x20做或运算即可统一为小写
+        if ((a[i] | 0x20) != (b[i] | 0x20)) {
+            return false;
         }
-        buff.updateReadPtrUntilEnd(lineEnd + 2);
     }
     return true;
 }
 
 void HTTPrequest::parsePath_() {
+    std::string_view& path = spans_.path;
     // API路由处理
-    if (path_.find("/api/") == 0) {
+    if (path.find("/api/") == 0) {
         // 保持API路径不变，不添加.html后缀
         return;
     }
-    
-    // 简化的HTML路由处理
-    if (path_ == "/") {
-        path_ = "/index.html";
-    } else if (path_ == "/index") {
-        path_ += ".html";
-    }
-}
 
-// 高性能手写解析 - 替代regex
-bool HTTPrequest::parseRequestLine_(std::string_view line) {
-    // 解析格式: METHOD PATH HTTP/VERSION
-    size_t first_space = findChar(line, ' ');
-    if (first_space == std::string_view::npos) return false;
-    
-    size_t second_space = findChar(line, ' ', first_space + 1);
-    if (second_space == std::string_view::npos) return false;
-    
-    // 检查HTTP前缀
-    if (line.substr(second_space + 1, 5) != "HTTP/") return false;
-    
-    method_ = line.substr(0, first_space);
-    path_ = line.substr(first_space + 1, second_space - first_space - 1);
-    version_ = line.substr(second_space + 6); // 跳过"HTTP/"
-    
-    state_ = HEADERS;
-    return true;
+    // 简化的HTML路由处理，改写后的路径指向静态字符串
+    if (path == "/" || path == "/index") {
+        path = "/index.html";
+    }
 }
 
-void HTTPrequest::parseRequestHeader_(std::string_view line) {
-    if (line.empty()) {
-        state_ = BODY;
-        return;
+std::string_view HTTPrequest::getPost(std::string_view key) const {
+    assert(!key.empty());
+    if (spans_.method != "POST" || contentType_ != "application/x-www-form-urlencoded") {
+        return std::string_view();
     }
-    
-    size_t colon_pos = findChar(line, ':');
-    if (colon_pos == std::string_view::npos) {
-        state_ = BODY;
-        return;
+
+    // 在body中直接查找key=value对
+    size_t start = 0;
+    while (start < body_.size()) {
+        size_t eq_pos = body_.find('=', start);
+        if (eq_pos == std::string_view::npos) break;
+
+        size_t amp_pos = body_.find('&', eq_pos + 1);
+        if (amp_pos == std::string_view::npos) amp_pos = body_.size();
+
+        if (body_.substr(start, eq_pos - start) == key) {
+            return body_.substr(eq_pos + 1, amp_pos - eq_pos - 1);
+        }
+        start = amp_pos + 1;
     }
-    
-    std::string key(line.substr(0, colon_pos));
-    std::string_view value = line.substr(colon_pos + 1);
-    
-    // 跳过值前面的空格
-    while (!value.empty() && value.front() == ' ') {
-        value.remove_prefix(1);
+    return std::string_view();
+}
+
+std::string_view HTTPrequest::header(std::string_view name) const {
+    for (size_t i = 0; i < spans_.numHeaders; ++i) {
+        if (equalsIgnoreCase_(spans_.headers[i].name, name)) {
+            return spans_.headers[i].value;
+        }
     }
-    
-    // 存储为string避免悬垂引用
-    header_[key] = std::string(value);
+    return std::string_view();
 }
 
-void HTTPrequest::parseDataBody_(std::string_view line) {
-    body_ = line;
-    parsePost_();
-    state_ = FINISH;
+std::string_view HTTPrequest::path() const {
+    return spans_.path;
 }
 
-void HTTPrequest::parsePost_() {
-    auto content_type_it = header_.find("Content-Type");
-    if (method_ == "POST" && content_type_it != header_.end() && 
-        content_type_it->second == "application/x-www-form-urlencoded") {
-        
-        if (body_.size() == 0) {
-            return;
-        }
+std::string_view HTTPrequest::method() const {
+    return spans_.method;
+}
 
-        // 解析POST数据并存储为string
-        std::string_view body_view = body_;
-        size_t start = 0;
-        
-        while (start < body_view.size()) {
-            size_t eq_pos = body_view.find('=', start);
-            if (eq_pos == std::string_view::npos) break;
-            
-            size_t amp_pos = body_view.find('&', eq_pos + 1);
-            if (amp_pos == std::string_view::npos) amp_pos = body_view.size();
-            
-            std::string key(body_view.substr(start, eq_pos - start));
-            std::string value(body_view.substr(eq_pos + 1, amp_pos - eq_pos - 1));
-            
-            post_[key] = value;
-            start = amp_pos + 1;
-        }
-    }
+std::string_view HTTPrequest::version() const {
+    return spans_.version;
 }
 
-// 快速字符查找辅助函数
-size_t HTTPrequest::findChar(std::string_view str, char ch, size_t start) {
-    for (size_t i = start; i < str.size(); ++i) {
-        if (str[i] == ch) return i;
-    }
-    return std::string_view::npos;
+std::string_view HTTPrequest::getBody() const {
+    return body_;
 }
 
-std::string HTTPrequest::path() const {
-    return path_;
+std::string_view HTTPrequest::host() const {
+    return host_;
 }
 
-std::string& HTTPrequest::path() {
-    return path_;
+std::string_view HTTPrequest::contentType() const {
+    return contentType_;
 }
 
-const std::string& HTTPrequest::path_ref() const {
-    return path_;
+std::string_view HTTPrequest::range() const {
+    return range_;
 }
 
-std::string HTTPrequest::method() const {
-    return method_;
+std::string_view HTTPrequest::ifRange() const {
+    return ifRange_;
 }
 
-std::string HTTPrequest::version() const {
-    return version_;
+std::string_view HTTPrequest::ifNoneMatch() const {
+    return ifNoneMatch_;
 }
 
-std::string HTTPrequest::getPost(const std::string& key) const {
-    assert(key != "");
-    auto it = post_.find(key);
-    if (it != post_.end()) {
-        return it->second;
-    }
-    return "";
+std::string_view HTTPrequest::ifModifiedSince() const {
+    return ifModifiedSince_;
 }
 
-std::string HTTPrequest::getPost(const char* key) const {
-    assert(key != nullptr);
-    auto it = post_.find(std::string(key));
-    if (it != post_.end()) {
-        return it->second;
-    }
-    return "";
+std::string_view HTTPrequest::acceptEncoding() const {
+    return acceptEncoding_;
 }
 
-std::string HTTPrequest::getBody() const {
-    return body_;
-}
\ No newline at end of file
+size_t HTTPrequest::contentLength() const {
+    return contentLength_;
+}
+
+bool HTTPrequest::isIncomplete() const {
+    return incomplete_;
+}
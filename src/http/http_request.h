@@ -1,12 +1,13 @@
 #ifndef HTTP_REQUEST_H
 #define HTTP_REQUEST_H
 
-#include <string>
 #include <string_view>
-#include <unordered_map>
 
 #include "buffer.h"
+#include "http_parser.h"
 
+// 请求的所有字段都是指向连接读缓冲区的视图，不做任何拷贝
+// 视图在下一次向读缓冲区写入数据之前有效，足以覆盖解析到生成响应的全过程
 class HTTPrequest {
 public:
     enum PARSE_STATE {
@@ -35,34 +36,61 @@ public:
     void init();
     bool parse(Buffer& buff);
 
-    std::string path() const;
-    std::string& path();
-    const std::string& path_ref() const;  // 新增避免拷贝的版本
-    std::string method() const;
-    std::string version() const;
-    std::string getPost(const std::string& key) const;
-    std::string getPost(const char* key) const;
-    std::string getBody() const;
+    std::string_view path() const;
+    std::string_view method() const;
+    std::string_view version() const;
+    std::string_view getBody() const;
+    // 表单字段按需在请求体中查找，不建立索引
+    std::string_view getPost(std::string_view key) const;
+
+    // 常用请求头在解析时解析到固定字段
+    std::string_view host() const;
+    std::string_view contentType() const;
+    size_t contentLength() const;
+    // Range和If-Range的原始值，由响应端结合文件大小解析
+    std::string_view range() const;
+    std::string_view ifRange() const;
+    // 条件请求的校验值
+    std::string_view ifNoneMatch() const;
+    std::string_view ifModifiedSince() const;
+    std::string_view acceptEncoding() const;
+    // 其他请求头按名称（不区分大小写）线性查找，不存在时返回空视图
+    std::string_view header(std::string_view name) const;
 
     bool isKeepAlive() const;
+    // 不解析，只取缓冲区中下一个请求的请求目标，请求行还没收全时为空
+    static std::string_view peekTarget(const Buffer& buff);
+    // parse失败是因为请求头尚未收全（而不是格式错误）
+    bool isIncomplete() const;
 
-private:
-    bool parseRequestLine_(std::string_view line);    // 使用string_view优化
-    void parseRequestHeader_(std::string_view line);  // 使用string_view优化
-    void parseDataBody_(std::string_view line);       // 使用string_view优化
+    static const size_t MAX_HEADER_SIZE = 8192;
+    static const size_t MAX_BODY_SIZE = 16 * 1024 * 1024;
 
+private:
     void parsePath_();
-    void parsePost_();
+    void rebase_(const char* base);
+    void resolveHeaders_();
 
-    // 快速字符串查找辅助函数
-    static size_t findChar(std::string_view str, char ch, size_t start = 0);
+    static bool equalsIgnoreCase_(std::string_view a, std::string_view b);
 
     PARSE_STATE state_;
-    std::string method_, path_, version_, body_;
-    
-    // 改回string以避免悬垂引用（Buffer在keep-alive时会被清空）
-    std::unordered_map<std::string, std::string> header_;
-    std::unordered_map<std::string, std::string> post_;
+    bool incomplete_;
+    size_t scanned_;          // 已确认不含请求头结尾的字节数
+    size_t headerLen_;
+    const char* base_;        // 解析请求头时请求在缓冲区中的起点
+
+    RequestSpans spans_;  // 请求行和请求头的原始视图
+    std::string_view body_;
+
+    std::string_view host_;
+    std::string_view contentType_;
+    std::string_view range_;
+    std::string_view ifRange_;
+    std::string_view ifNoneMatch_;
+    std::string_view ifModifiedSince_;
+    std::string_view acceptEncoding_;
+    size_t contentLength_;
+    bool keepAlive_;
 };
 
-#endif  // HTTP_REQUEST_H
\ No newline at end of file
+#endif  // HTTP_REQUEST_H
@@ -1,48 +1,128 @@
 #include "http_response.h"
+#include "precompress.h"
 #include <sys/sendfile.h>
-#include <algorithm>  // for std::lower_bound
-
-const std::unordered_map<std::string_view, std::string_view> HTTPresponse::SUFFIX_TYPE = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpv",   "video/mpv" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css" },
-    { ".js",    "text/javascript" },
+#include <charconv>
+#include <ctime>
+#include <random>
+#include <strings.h>
+
+namespace {
+
+// 状态行整行预先拼好，错误码附带对应的错误页面
+constexpr HTTPresponse::Status STATUSES[] = {
+    { 200, "HTTP/1.1 200 OK\r\n", "OK", "" },
+    { 206, "HTTP/1.1 206 Partial Content\r\n", "Partial Content", "" },
+    { 304, "HTTP/1.1 304 Not Modified\r\n", "Not Modified", "" },
+    { 400, "HTTP/1.1 400 Bad Request\r\n", "Bad Request", "/400.html" },
+    { 403, "HTTP/1.1 403 Forbidden\r\n", "Forbidden", "/403.html" },
+    { 404, "HTTP/1.1 404 Not Found\r\n", "Not Found", "/404.html" },
+    { 416, "HTTP/1.1 416 Range Not Satisfiable\r\n", "Range Not Satisfiable", "" },
+};
+
+// 按扩展名长度分组，查找时先按长度分派，组内只有几项，逐个比较
+constexpr HTTPresponse::MimeType MIME_2[] = {
+    { "js", "text/javascript" },
+    { "au", "audio/basic" },
+    { "gz", "application/x-gzip" },
+};
+
+constexpr HTTPresponse::MimeType MIME_3[] = {
+    { "css", "text/css" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "svg", "image/svg+xml" },
+    { "ico", "image/x-icon" },
+    { "htm", "text/html" },
+    { "xml", "text/xml" },
+    { "txt", "text/plain" },
+    { "pdf", "application/pdf" },
+    { "rtf", "application/rtf" },
+    { "mp4", "video/mp4" },
+    { "mpv", "video/mpv" },
+    { "avi", "video/x-msvideo" },
+    { "tar", "application/x-tar" },
 };
 
-const std::unordered_map<int, std::string_view> HTTPresponse::CODE_STATUS = {
-    { 200, "OK" },
-    { 400, "Bad Request" },
-    { 403, "Forbidden" },
-    { 404, "Not Found" },
+constexpr HTTPresponse::MimeType MIME_4[] = {
+    { "html", "text/html" },
+    { "json", "application/json" },
+    { "webp", "image/webp" },
+    { "jpeg", "image/jpeg" },
+    { "woff", "font/woff" },
+    { "wasm", "application/wasm" },
+    { "mpeg", "video/mpeg" },
+    { "word", "application/msword" },
 };
 
-const std::unordered_map<int, std::string_view> HTTPresponse::CODE_PATH = {
-    { 400, "/400.html" },
-    { 403, "/403.html" },
-    { 404, "/404.html" },
+constexpr HTTPresponse::MimeType MIME_5[] = {
+    { "woff2", "font/woff2" },
+    { "xhtml", "application/xhtml+xml" },
 };
 
+template <size_t N>
+constexpr std::string_view lookupMime(const HTTPresponse::MimeType (&table)[N], std::string_view suffix) {
+    for (const auto& m : table) {
+        if (m.suffix == suffix) {
+            return m.type;
+        }
+    }
+    return "text/plain";
+}
+
+}  // namespace
+
+const HTTPresponse::Status* HTTPresponse::findStatus_(int code) {
+    switch (code) {
+        case 200: return &STATUSES[0];
+        case 206: return &STATUSES[1];
+        case 304: return &STATUSES[2];
+        case 400: return &STATUSES[3];
+        case 403: return &STATUSES[4];
+        case 404: return &STATUSES[5];
+        case 416: return &STATUSES[6];
+        default: return nullptr;
+    }
+}
+
+std::string_view HTTPresponse::findMimeType_(std::string_view suffix) {
+    // 扩展名不区分大小写，转成小写放在栈上比较
+    char lower[8];
+    if (suffix.size() > sizeof(lower)) {
+        return "text/plain";
+    }
+    for (size_t i = 0; i < suffix.size(); ++i) {
+        char c = suffix[i];
+        lower[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    std::string_view key(lower, suffix.size());
+    switch (key.size()) {
+        case 2: return lookupMime(MIME_2, key);
+        case 3: return lookupMime(MIME_3, key);
+        case 4: return lookupMime(MIME_4, key);
+        case 5: return lookupMime(MIME_5, key);
+        default: return "text/plain";
+    }
+}
+
+// multipart/byteranges的分隔符，进程启动时随机生成一次
+const std::string HTTPresponse::BOUNDARY = []() {
+    std::random_device rd;
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%08x%08x", rd(), rd());
+    return std::string(buf);
+}();
+
+std::string HTTPresponse::precompressDir;
+
 HTTPresponse::HTTPresponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
-    mmFile_ = nullptr;
-    mmFileStat_ = {0};
+    prebuilt_ = nullptr;
+    rangeCnt_ = 0;
+    encoding_ = nullptr;
+    vary_ = false;
 };
 
 HTTPresponse::~HTTPresponse() {
@@ -50,204 +130,503 @@ HTTPresponse::~HTTPresponse() {
 }
 
 void HTTPresponse::init(std::string_view srcDir, std::string_view path, bool isKeepAlive, int code) {
-    if (mmFile_) {
-        unmapFile_();
-    }
+    file_.reset();
+    prebuilt_ = nullptr;
+    range_ = ifRange_ = ifNoneMatch_ = ifModifiedSince_ = acceptEncoding_ = std::string_view();
+    rangeCnt_ = 0;
+    encoding_ = nullptr;
+    vary_ = false;
     code_ = code;
     isKeepAlive_ = isKeepAlive;
-    path_ = path;  // 延迟拷贝，只在需要时才转为string
-    srcDir_ = srcDir;  // 延迟拷贝
-    mmFile_ = nullptr;
-    mmFileStat_ = {0};
+    path_ = path;  // assign复用已有容量，稳定后不再分配
+    srcDir_ = srcDir;
+    updateFilePath_();
+}
+
+void HTTPresponse::setRange(std::string_view range, std::string_view ifRange) {
+    range_ = range;
+    ifRange_ = ifRange;
+}
+
+void HTTPresponse::setValidators(std::string_view ifNoneMatch, std::string_view ifModifiedSince) {
+    ifNoneMatch_ = ifNoneMatch;
+    ifModifiedSince_ = ifModifiedSince;
+}
+
+void HTTPresponse::setAcceptEncoding(std::string_view acceptEncoding) {
+    acceptEncoding_ = acceptEncoding;
+}
+
+void HTTPresponse::updateFilePath_() {
+    filePath_.assign(srcDir_);
+    filePath_.append(path_);
 }
 
 void HTTPresponse::makeResponse(Buffer& buff) {
-    if (stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;
-    } else if (!(mmFileStat_.st_mode & S_IROTH)) {
+    prebuilt_ = nullptr;
+    rangeCnt_ = 0;
+    encoding_ = nullptr;
+    vary_ = code_ == 200 && isCompressibleAsset(path_);
+    // Range请求总是发送原文件，避免对压缩副本做分段
+    const bool negotiate = vary_ && !acceptEncoding_.empty() && range_.empty();
+    const bool conditional = code_ == 200 && (!ifNoneMatch_.empty() || !ifModifiedSince_.empty());
+    if (conditional && !negotiate && notModified_(buff)) {
+        return;
+    }
+    // fd、stat结果和映射都来自打开文件缓存，命中时没有任何系统调用
+    int err = 0;
+    file_ = FileCache::getInstance().get(filePath_, &err);
+    if (!file_) {
+        code_ = err == EACCES ? 403 : 404;
+    } else if (!(file_->st.st_mode & S_IROTH)) {
+        file_.reset();
         code_ = 403;
     } else if (code_ == -1) {
         code_ = 200;
     }
     errorHTML_();
+    if (negotiate && code_ == 200) {
+        // 需要协商时校验值取决于选中的副本，只能在选定之后比较
+        selectEncoding_();
+        if (conditional && validatorsMatch_(file_->st, file_->etag, file_->lastModified)) {
+            addNotModified_(buff, file_->etag, file_->lastModified);
+            file_.reset();
+            return;
+        }
+    }
+    if (code_ == 200 && !range_.empty() && ifRangeMatches_()) {
+        parseRange_();  // 可能把code_改为206或416
+    }
+    if (code_ == 206 || code_ == 416) {
+        addStateLine_(buff);
+        addResponseHeader_(buff);
+        buff.append(getCachedDateHeader());
+        addRangeContent_(buff);
+        return;
+    }
+    if (file_ && file_->size <= PREBUILT_MAX_SIZE) {
+        // 小文件直接复用预构建的完整响应，写缓冲区里只放当前的Date头
+        prebuilt_ = file_->findPrebuilt(code_, isKeepAlive_, encoding_ != nullptr);
+        if (!prebuilt_) {
+            prebuilt_ = file_->publishPrebuilt(buildPrebuilt_());
+        }
+        if (prebuilt_) {
+            buff.append(getCachedDateHeader());
+            return;
+        }
+    }
+    addStateLine_(buff);
+    addResponseHeader_(buff);
+    // 使用缓存的Date头，避免每次strftime调用
+    buff.append(getCachedDateHeader());
+    addContent_(buff);
+}
+
+std::unique_ptr<PrebuiltResponse> HTTPresponse::buildPrebuilt_() {
+    // 与makeResponse的常规路径生成完全相同的字节，只是在Date处断开
+    Buffer buff(256 + file_->size);
     addStateLine_(buff);
     addResponseHeader_(buff);
+    auto resp = std::make_unique<PrebuiltResponse>();
+    resp->code = code_;
+    resp->keepAlive = isKeepAlive_;
+    resp->encoded = encoding_ != nullptr;
+    resp->headLen = buff.readableBytes();
     addContent_(buff);
+    if (file_->size > 0) {
+        buff.append(file_->data, file_->size);
+    }
+    resp->block.assign(buff.curReadPtr(), buff.readableBytes());
+    return resp;
+}
+
+bool HTTPresponse::notModified_(Buffer& buff) {
+    // 缓存命中时直接用缓存的校验值；未命中时只stat，不打开也不映射文件
+    std::shared_ptr<const CachedFile> cached = FileCache::getInstance().find(filePath_);
+    struct stat st;
+    std::string etagBuf;
+    std::string dateBuf;
+    std::string_view etag;
+    std::string_view lastModified;
+    if (cached) {
+        st = cached->st;
+        etag = cached->etag;
+        lastModified = cached->lastModified;
+    } else {
+        if (stat(filePath_.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        etag = etagBuf = CachedFile::makeETag(st);
+        lastModified = dateBuf = CachedFile::makeHttpDate(st.st_mtime);
+    }
+    if (!(st.st_mode & S_IROTH) || !validatorsMatch_(st, etag, lastModified)) {
+        return false;
+    }
+    addNotModified_(buff, etag, lastModified);
+    return true;
+}
+
+bool HTTPresponse::validatorsMatch_(const struct stat& st, std::string_view etag,
+                                    std::string_view lastModified) const {
+    // 同时存在时If-None-Match优先，If-Modified-Since被忽略
+    if (!ifNoneMatch_.empty()) {
+        return etagMatches_(ifNoneMatch_, etag);
+    }
+    if (ifModifiedSince_ == lastModified) {
+        return true;
+    }
+    struct tm tm = {};
+    std::string since(ifModifiedSince_);
+    const char* end = strptime(since.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return end && *end == '\0' && st.st_mtime <= timegm(&tm);
+}
+
+void HTTPresponse::addNotModified_(Buffer& buff, std::string_view etag, std::string_view lastModified) {
+    code_ = 304;
+    addStateLine_(buff);
+    buff.append(isKeepAlive_ ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+    if (vary_) {
+        buff.append("Vary: Accept-Encoding\r\n");
+    }
+    buff.appendAll("ETag: ", etag, "\r\nLast-Modified: ", lastModified, "\r\n", getCachedDateHeader(), "\r\n");
+}
+
+bool HTTPresponse::acceptsEncoding_(std::string_view name) const {
+    // 只区分接受与拒绝（q=0），不比较q值大小，按服务端的偏好顺序选择
+    std::string_view list = acceptEncoding_;
+    bool wildcard = false;
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        size_t semi = item.find(';');
+        std::string_view token = item.substr(0, semi);
+        while (!token.empty() && (token.front() == ' ' || token.front() == '\t')) {
+            token.remove_prefix(1);
+        }
+        while (!token.empty() && (token.back() == ' ' || token.back() == '\t')) {
+            token.remove_suffix(1);
+        }
+        bool refused = false;
+        if (semi != std::string_view::npos) {
+            std::string_view params = item.substr(semi + 1);
+            size_t q = params.find("q=");
+            if (q != std::string_view::npos) {
+                std::string_view value = params.substr(q + 2);
+                size_t end = value.find_first_not_of("0.");
+                refused = end != 0 && (end == std::string_view::npos || value[end] == ' ' || value[end] == ';');
+            }
+        }
+        if (token.size() == name.size() && strncasecmp(token.data(), name.data(), name.size()) == 0) {
+            return !refused;
+        }
+        if (token == "*") {
+            wildcard = !refused;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return wildcard;
+}
+
+void HTTPresponse::selectEncoding_() {
+    // br优先于gzip；先找与原文件同目录的副本，再找启动时预压缩的目录
+    // 查找结果（包括不存在）由文件缓存记住，稳定后没有系统调用
+    static const struct {
+        const char* name;
+        const char* ext;
+    } ENCODINGS[] = {{"br", ".br"}, {"gzip", ".gz"}};
+    thread_local std::string candidate;
+    int err = 0;
+    for (const auto& enc : ENCODINGS) {
+        if (!acceptsEncoding_(enc.name)) {
+            continue;
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (i == 0) {
+                candidate.assign(filePath_);
+            } else if (!precompressDir.empty()) {
+                candidate.assign(precompressDir);
+                candidate.append(path_);
+            } else {
+                break;
+            }
+            candidate.append(enc.ext);
+            std::shared_ptr<const CachedFile> variant = FileCache::getInstance().get(candidate, &err, true);
+            // 比原文件旧的副本视为过期
+            if (variant && (variant->st.st_mode & S_IROTH) && variant->st.st_mtime >= file_->st.st_mtime) {
+                file_ = std::move(variant);
+                encoding_ = enc.name;
+                return;
+            }
+        }
+    }
+}
+
+bool HTTPresponse::etagMatches_(std::string_view list, std::string_view etag) {
+    // 弱比较：忽略两边的W/前缀，"*"匹配任何存在的文件
+    if (etag.compare(0, 2, "W/") == 0) {
+        etag.remove_prefix(2);
+    }
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view tag = list.substr(0, comma);
+        while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) {
+            tag.remove_prefix(1);
+        }
+        while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) {
+            tag.remove_suffix(1);
+        }
+        if (tag.compare(0, 2, "W/") == 0) {
+            tag.remove_prefix(2);
+        }
+        if (tag == "*" || tag == etag) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool HTTPresponse::ifRangeMatches_() const {
+    if (ifRange_.empty()) {
+        return true;
+    }
+    // If-Range要求强比较：弱标签永不匹配，日期须与Last-Modified完全一致
+    if (ifRange_.compare(0, 2, "W/") == 0) {
+        return false;
+    }
+    if (ifRange_.front() == '"') {
+        return ifRange_ == file_->etag;
+    }
+    return ifRange_ == file_->lastModified;
+}
+
+void HTTPresponse::parseRange_() {
+    // 只支持bytes单位；格式错误或段数超过MAX_RANGES时忽略Range，按200发送整个文件
+    std::string_view spec = range_;
+    if (spec.compare(0, 6, "bytes=") != 0) {
+        return;
+    }
+    spec.remove_prefix(6);
+    auto parseNum = [](std::string_view v, size_t* out) {
+        auto res = std::from_chars(v.data(), v.data() + v.size(), *out);
+        return !v.empty() && res.ec == std::errc() && res.ptr == v.data() + v.size();
+    };
+    const size_t size = file_->size;
+    int items = 0;
+    int cnt = 0;
+    while (true) {
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) {
+            item.remove_suffix(1);
+        }
+        if (!item.empty()) {
+            ++items;
+            size_t dash = item.find('-');
+            if (dash == std::string_view::npos) {
+                return;
+            }
+            size_t first = 0;
+            size_t last = size - 1;
+            if (dash == 0) {
+                // 后缀形式"-N"：最后N个字节
+                size_t suffix = 0;
+                if (!parseNum(item.substr(1), &suffix)) {
+                    return;
+                }
+                if (suffix == 0) {
+                    first = size;  // "-0"不可满足
+                } else {
+                    first = suffix < size ? size - suffix : 0;
+                }
+            } else {
+                if (!parseNum(item.substr(0, dash), &first)) {
+                    return;
+                }
+                if (dash + 1 < item.size()) {
+                    size_t end = 0;
+                    if (!parseNum(item.substr(dash + 1), &end) || end < first) {
+                        return;
+                    }
+                    last = std::min(end, size - 1);
+                }
+            }
+            if (first < size) {
+                if (cnt == MAX_RANGES) {
+                    return;
+                }
+                ranges_[cnt++] = {first, last - first + 1, 0};
+            }
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        spec.remove_prefix(comma + 1);
+    }
+    if (items == 0) {
+        return;
+    }
+    rangeCnt_ = cnt;
+    code_ = cnt > 0 ? 206 : 416;
+}
+
+void HTTPresponse::appendContentRange_(Buffer& buff, const ByteRange& r) const {
+    buff.appendAll("Content-Range: bytes ", r.first, "-", r.first + r.len - 1, "/", file_->size, "\r\n");
+}
+
+void HTTPresponse::addRangeContent_(Buffer& buff) {
+    if (code_ == 416) {
+        // 没有可满足的段，告知文件长度，不发送内容
+        buff.appendAll("Content-Range: bytes */", file_->size, "\r\nContent-length: 0\r\n\r\n");
+        file_.reset();
+        return;
+    }
+    if (rangeCnt_ == 1) {
+        appendContentRange_(buff, ranges_[0]);
+        buff.appendAll("Content-length: ", ranges_[0].len, "\r\n\r\n");
+        ranges_[0].bufPos = buff.readableBytes();
+        return;
+    }
+    // 多段：各段的multipart头和结尾分隔符都在写缓冲区中，文件内容由连接插入到bufPos处
+    // 总长度要写在它们前面，先在线程内复用的缓冲区里生成
+    thread_local Buffer parts(1024);
+    parts.initPtr();
+    size_t partEnd[MAX_RANGES];
+    size_t bodyLen = 0;
+    auto type = getFileType_();
+    for (int i = 0; i < rangeCnt_; ++i) {
+        parts.appendAll(i == 0 ? "--" : "\r\n--", BOUNDARY, "\r\nContent-Type: ", type, "\r\n");
+        appendContentRange_(parts, ranges_[i]);
+        parts.append("\r\n");
+        partEnd[i] = parts.readableBytes();
+        bodyLen += ranges_[i].len;
+    }
+    parts.appendAll("\r\n--", BOUNDARY, "--\r\n");
+    buff.appendAll("Content-length: ", parts.readableBytes() + bodyLen, "\r\n\r\n");
+    const size_t base = buff.readableBytes();
+    buff.append(parts.view());
+    for (int i = 0; i < rangeCnt_; ++i) {
+        ranges_[i].bufPos = base + partEnd[i];
+    }
+}
+
+int HTTPresponse::rangeCount() const {
+    return rangeCnt_;
+}
+
+const HTTPresponse::ByteRange& HTTPresponse::range(int i) const {
+    assert(i >= 0 && i < rangeCnt_);
+    return ranges_[i];
+}
+
+const PrebuiltResponse* HTTPresponse::prebuilt() const {
+    return prebuilt_;
 }
 
 char* HTTPresponse::file() {
-    return mmFile_;
+    return file_ ? file_->data : nullptr;
 }
 
 size_t HTTPresponse::fileLen() const {
-    return mmFileStat_.st_size;
+    return file_ ? file_->size : 0;
 }
 
 void HTTPresponse::errorHTML_() {
-    if (CODE_PATH.count(code_) == 1) {
-        path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+    const Status* status = findStatus_(code_);
+    if (status && !status->errorPage.empty()) {
+        path_ = status->errorPage;
+        updateFilePath_();
+        int err = 0;
+        file_ = FileCache::getInstance().get(filePath_, &err);
     }
 }
 
 void HTTPresponse::addStateLine_(Buffer& buffer) {
-    std::string_view status;
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
+    const Status* status = findStatus_(code_);
+    if(!status) {
         code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+        status = findStatus_(400);
     }
-    buffer.append("HTTP/1.1 " + std::to_string(code_) + " ");
-    buffer.append(status.data(), status.size());
-    buffer.append("\r\n");
+    buffer.append(status->line);
 }
 
 void HTTPresponse::addResponseHeader_(Buffer& buffer) {
-    buffer.append("Connection: ");
-    if(isKeepAlive_) {
-        buffer.append("keep-alive\r\n");
-    } else{
-        buffer.append("close\r\n");
-    }
-    buffer.append("Content-Type: ");
-    auto file_type = getFileType_();
-    buffer.append(file_type.data(), file_type.size());
-    buffer.append("\r\n");
-    
-    // 使用缓存的Date头，避免每次strftime调用
-    buffer.append(getCachedDateHeader());
+    buffer.append(isKeepAlive_ ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+    if (rangeCnt_ > 1) {
+        buffer.appendAll("Content-Type: multipart/byteranges; boundary=", BOUNDARY, "\r\n");
+    } else {
+        buffer.appendAll("Content-Type: ", getFileType_(), "\r\n");
+    }
+    if (encoding_) {
+        buffer.appendAll("Content-Encoding: ", encoding_, "\r\n");
+    }
+    if (vary_ && (code_ == 200 || code_ == 206)) {
+        buffer.append("Vary: Accept-Encoding\r\n");
+    }
+    if ((code_ == 200 || code_ == 206) && file_) {
+        if (code_ == 200 && !encoding_) {
+            buffer.append("Accept-Ranges: bytes\r\n");
+        }
+        buffer.appendAll("ETag: ", file_->etag, "\r\nLast-Modified: ", file_->lastModified, "\r\n");
+    }
 }
 
 void HTTPresponse::addContent_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if (srcFd < 0) {
+    if (!file_) {
         errorContent(buff, "File NotFound!");
         return;
     }
-    
-    fileFd_.reset(srcFd);  // 使用RAII管理
-    
-    // 内存映射文件
-    mmFile_ = (char*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if (mmFile_ == MAP_FAILED) {
-        errorContent(buff, "File mmap error!");
-        return;
-    }
-    
-    buff.append("Content-length: " + std::to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    buff.appendAll("Content-length: ", file_->size, "\r\n\r\n");
+}
+
+std::shared_ptr<const CachedFile> HTTPresponse::releaseFile() {
+    prebuilt_ = nullptr;
+    return std::move(file_);
 }
 
 void HTTPresponse::unmapFile_() {
-    fileFd_.close();  // RAII自动管理
-    if (mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
-    }
+    prebuilt_ = nullptr;
+    file_.reset();  // 映射由缓存和其他连接共享，最后一个引用释放时才真正munmap
 }
 
 std::string_view HTTPresponse::getFileType_() {
-    // 使用thread_local LRU缓存，避免每个对象存储缓存
-    thread_local static std::unordered_map<std::string, std::string_view> cache;
-    
-    std::string::size_type idx = path_.find_last_of('.');
-    if (idx == std::string::npos) {
+    // 常量表查找，不分配内存；没有扩展名或未知扩展名按纯文本处理
+    std::string_view path = path_;
+    size_t idx = path.find_last_of("./");
+    if (idx == std::string_view::npos || path[idx] != '.') {
         return "text/plain";
     }
-    
-    std::string suffix(path_.data() + idx, path_.size() - idx);
-    
-    // 查找缓存
-    auto cache_it = cache.find(suffix);
-    if (cache_it != cache.end()) {
-        return cache_it->second;
-    }
-    
-    // 查找MIME类型
-    auto it = SUFFIX_TYPE.find(suffix);
-    std::string_view mime_type = (it != SUFFIX_TYPE.end()) ? it->second : "text/plain";
-    
-    // 简单LRU：限制缓存大小
-    if (cache.size() >= 128) {
-        cache.clear();  // 简单清空策略
-    }
-    cache[suffix] = mime_type;
-    
-    return mime_type;
+    return findMimeType_(path.substr(idx + 1));
 }
 
 // 静态CGI处理器实例
 CGIHandler HTTPresponse::cgiHandler_;
 
-void HTTPresponse::makeCGIResponse(Buffer& buffer, const std::string& method, const std::string& body, const std::string& queryString) {
+void HTTPresponse::makeCGIResponse(Buffer& buffer, std::string_view method, std::string_view body, std::string_view queryString,
+                                   std::unique_ptr<CgiProcess>* async) {
     // 使用CGI处理器处理请求
-    cgiHandler_.handleCGI(path_, method, body, queryString, buffer);
+    cgiHandler_.handleCGI(path_, method, body, queryString, buffer, async);
 }
 
 void HTTPresponse::errorContent(Buffer& buff, std::string_view message) {
-    std::string body;
-    std::string_view status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
-    if (CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    } else {
-        status = "Bad Request";
-    }
-    body += std::to_string(code_) + " : " + status.data() + "\n";
-    body += "<p>" + std::string(message.data()) + "</p>";
-    body += "<hr><em>TinyWebServer</em></body></html>";
-
-    buff.append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-    buff.append(body);
-}
-
-// 高性能TCP_CORK + sendfile优化
-ssize_t HTTPresponse::sendFileOptimized(int sockFd, const Buffer& headerBuffer) {
-    if (!fileFd_) {
-        return 0;
-    }
-    
-    ssize_t totalSent = 0;
-    off_t offset = 0;
-    ssize_t remain = mmFileStat_.st_size;
-    
-    // 1. 启用TCP_CORK，聚合小包
-    int cork = 1;
-    if (setsockopt(sockFd, SOL_TCP, TCP_CORK, &cork, sizeof(cork)) < 0) {
-        // TCP_CORK失败时回退到普通方式
-        return -1;
-    }
-    
-    // 2. 发送HTTP头
-    const char* headerData = headerBuffer.curReadPtr();
-    size_t headerSize = headerBuffer.readableBytes();
-    ssize_t headerSent = send(sockFd, headerData, headerSize, MSG_NOSIGNAL);
-    if (headerSent < 0) {
-        // 禁用TCP_CORK
-        cork = 0;
-        setsockopt(sockFd, SOL_TCP, TCP_CORK, &cork, sizeof(cork));
-        return headerSent;
-    }
-    totalSent += headerSent;
-    
-    // 3. 使用sendfile发送文件内容 - 零拷贝
-    while (remain > 0) {
-        ssize_t sent = sendfile(sockFd, fileFd_.get(), &offset, remain);
-        if (sent <= 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                continue;  // 重试
-            }
-            break;
-        }
-        remain -= sent;
-        totalSent += sent;
+    static constexpr std::string_view HEAD = "<html><title>Error</title><body bgcolor=\"ffffff\">";
+    static constexpr std::string_view TAIL = "</p><hr><em>TinyWebServer</em></body></html>";
+    std::string_view status = "Bad Request";
+    if (const Status* s = findStatus_(code_)) {
+        status = s->reason;
     }
-    
-    // 4. 禁用TCP_CORK，立即发送
-    cork = 0;
-    setsockopt(sockFd, SOL_TCP, TCP_CORK, &cork, sizeof(cork));
-    
-    return totalSent;
-}
\ No newline at end of file
+    // Content-length要写在内容前面，先算出状态码的十进制长度
+    char code[12];
+    std::string_view codeStr(code, std::to_chars(code, code + sizeof(code), code_).ptr - code);
+    const size_t len = HEAD.size() + codeStr.size() + 3 + status.size() + 4 + message.size() + TAIL.size();
+    buff.appendAll("Content-length: ", len, "\r\n\r\n", HEAD, codeStr, " : ", status, "\n<p>", message, TAIL);
+}
@@ -5,17 +5,15 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
-#include <sys/sendfile.h>
-#include <netinet/tcp.h>
 #include <unistd.h>
 
-#include <unordered_map>
+#include <memory>
 #include <string>
 #include <string_view>
 
 #include "buffer.h"
 #include "cgi_handler.h"
-#include "unique_fd.h"
+#include "file_cache.h"
 #include "date_cache.h"
 
 class HTTPresponse {
@@ -23,42 +21,104 @@ public:
     HTTPresponse();
     ~HTTPresponse();
 
+    // 206响应中的一段文件内容，bufPos是它在写缓冲区中的插入位置（可读字节数）
+    struct ByteRange {
+        size_t first;
+        size_t len;
+        size_t bufPos;
+    };
+
     void init(std::string_view srcDir, std::string_view path, bool isKeepAlive = false, int code = -1);
+    // GET请求的Range/If-Range原始值，视图须在makeResponse返回前有效
+    void setRange(std::string_view range, std::string_view ifRange);
+    // GET请求的If-None-Match/If-Modified-Since，校验值匹配时makeResponse生成304
+    void setValidators(std::string_view ifNoneMatch, std::string_view ifModifiedSince);
+    // 客户端的Accept-Encoding，存在预压缩副本时改为发送副本
+    void setAcceptEncoding(std::string_view acceptEncoding);
     void makeResponse(Buffer& buffer);
-    void makeCGIResponse(Buffer& buffer, const std::string& method, const std::string& body, const std::string& queryString);
+    // CGI脚本异步执行，子进程存入*async，见CGIHandler::handleCGI
+    void makeCGIResponse(Buffer& buffer, std::string_view method, std::string_view body, std::string_view queryString,
+                         std::unique_ptr<CgiProcess>* async);
     void unmapFile_();
     char* file();
     size_t fileLen() const;
+    // 交出对缓存文件的引用，连接在整批响应写完前持有它
+    std::shared_ptr<const CachedFile> releaseFile();
+    // makeResponse走了预构建路径时非空，写缓冲区中只有Date头，生命周期跟随文件引用
+    const PrebuiltResponse* prebuilt() const;
+
+    // makeResponse生成206响应时的分段，单段时头部之后紧跟文件内容，
+    // 多段时写缓冲区中依次是各段的multipart头和结尾的分隔符
+    int rangeCount() const;
+    const ByteRange& range(int i) const;
+
+    // 启动时预压缩副本所在目录，目录结构与资源目录一致，为空时只查找与原文件同目录的副本
+    static std::string precompressDir;
+
+    // 状态码表项：完整状态行、原因短语和错误页面路径（没有时为空）
+    struct Status {
+        int code;
+        std::string_view line;
+        std::string_view reason;
+        std::string_view errorPage;
+    };
+    // 扩展名（不含点，小写）到Content-Type的表项
+    struct MimeType {
+        std::string_view suffix;
+        std::string_view type;
+    };
+
+    static const size_t PREBUILT_MAX_SIZE = 32 * 1024;
+    static const int MAX_RANGES = 8;
     void errorContent(Buffer& buffer, std::string_view message);
-    
-    // 高性能sendfile方法，使用TCP_CORK优化
-    ssize_t sendFileOptimized(int sockFd, const Buffer& headerBuffer);
 
 private:
     void addStateLine_(Buffer& buffer);
     void addResponseHeader_(Buffer& buffer);
     void addContent_(Buffer& buffer);
+    void addRangeContent_(Buffer& buffer);
+
+    bool notModified_(Buffer& buffer);
+    bool validatorsMatch_(const struct stat& st, std::string_view etag, std::string_view lastModified) const;
+    void addNotModified_(Buffer& buffer, std::string_view etag, std::string_view lastModified);
+    bool acceptsEncoding_(std::string_view name) const;
+    void selectEncoding_();
+    static bool etagMatches_(std::string_view list, std::string_view etag);
+    bool ifRangeMatches_() const;
+    void parseRange_();
+    void appendContentRange_(Buffer& buff, const ByteRange& r) const;
 
     void errorHTML_();
+    void updateFilePath_();
+    std::unique_ptr<PrebuiltResponse> buildPrebuilt_();
     std::string_view getFileType_();
+    static const Status* findStatus_(int code);
+    static std::string_view findMimeType_(std::string_view suffix);
 
     int code_;
     bool isKeepAlive_;
 
     std::string path_;
     std::string srcDir_;
+    std::string filePath_;  // srcDir_ + path_，每个请求只拼接一次
 
-    char* mmFile_;
-    struct stat mmFileStat_;
+    std::shared_ptr<const CachedFile> file_;
+    const PrebuiltResponse* prebuilt_;
 
-    unique_fd fileFd_;  // 使用RAII管理文件描述符
+    std::string_view range_;
+    std::string_view ifRange_;
+    std::string_view ifNoneMatch_;
+    std::string_view ifModifiedSince_;
+    std::string_view acceptEncoding_;
+    const char* encoding_;  // 发送的是压缩副本时为Content-Encoding的值
+    bool vary_;             // 可压缩类型的响应都带Vary: Accept-Encoding
+    ByteRange ranges_[MAX_RANGES];
+    int rangeCnt_;
     
     // CGI处理器
     static CGIHandler cgiHandler_;
 
-    static const std::unordered_map<std::string_view, std::string_view> SUFFIX_TYPE;
-    static const std::unordered_map<int, std::string_view> CODE_STATUS;
-    static const std::unordered_map<int, std::string_view> CODE_PATH;
+    static const std::string BOUNDARY;
 };
 
 #endif  // HTTP_RESPONSE_H
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include <unistd.h>
+#include <getopt.h>
+#include <cstdlib>
 #include <thread>
 #include <sys/resource.h>
 #include <iostream>
+#include <string>
 #include "webserver.h"
+#include "fastcgi_client.h"
 
 void optimizeSystem() {
     // 设置进程优先级
@@ -38,18 +42,68 @@ void optimizeSystem() {
     }
 }
 
-int main() 
+int main(int argc, char* argv[]) 
 {
+    // 命令行参数：-r N 启用多Reactor模式（N为0时使用核心数）；-e uring 使用io_uring后端；
+    // -z 启动时预压缩文本资源；-f prefix=socket 把该前缀下的CGI请求转发给FastCGI后端（可多次指定）
+    int reactor_num = -1;
+    bool io_uring = false;
+    bool precompress = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:e:zf:")) != -1) {
+        switch (opt) {
+            case 'r':
+                reactor_num = std::atoi(optarg);
+                if (reactor_num <= 0) {
+                    reactor_num = std::max(1u, std::thread::hardware_concurrency());
+                }
+                break;
+            case 'e':
+                if (std::string(optarg) == "uring") {
+                    io_uring = true;
+                } else if (std::string(optarg) != "epoll") {
+                    std::cerr << "Unknown engine: " << optarg << std::endl;
+                    return 1;
+                }
+                break;
+            case 'z':
+                precompress = true;
+                break;
+            case 'f': {
+                std::string spec(optarg);
+                size_t eq = spec.find('=');
+                if (eq == std::string::npos || eq == 0 || eq + 1 == spec.size()) {
+                    std::cerr << "Bad FastCGI backend: " << optarg << std::endl;
+                    return 1;
+                }
+                addFastCGIBackend(spec.substr(0, eq), spec.substr(eq + 1));
+                break;
+            }
+            default:
+                std::cerr << "Usage: " << argv[0]
+                          << " [-r reactors] [-e epoll|uring] [-z] [-f /cgi-bin/prefix=/path/to/socket]" << std::endl;
+                return 1;
+        }
+    }
+
     // 系统优化
     optimizeSystem();
     
     // 使用更保守的线程数策略：CPU核心数的1.5倍，最少4个，最多16个
     size_t thread_num = std::max(4u, std::min(16u, 
         static_cast<unsigned int>(std::thread::hardware_concurrency() * 1.5)));
-    std::cout << "Using " << thread_num << " worker threads" << std::endl;
+    if (io_uring && reactor_num <= 0) {
+        reactor_num = 1;
+    }
+    if (reactor_num > 0) {
+        std::cout << "Using " << reactor_num << (io_uring ? " io_uring" : "") << " reactors" << std::endl;
+    } else {
+        reactor_num = 0;
+        std::cout << "Using " << thread_num << " worker threads" << std::endl;
+    }
     
     // 端口8000，边缘触发模式，60秒超时，不启用linger，使用优化的线程数
-    WebServer server(8000, 3, 60000, false, thread_num);
+    WebServer server(8000, 3, 60000, false, thread_num, reactor_num, io_uring, precompress);
     server.Start();
     
     return 0;
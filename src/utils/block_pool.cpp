@@ -0,0 +1,83 @@
+#include "block_pool.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+// 平凡类型的thread_local在线程退出时不析构，池销毁后仍可安全读取
+thread_local bool poolDestroyed = false;
+}
+
+BlockPool::~BlockPool() {
+    for (FreeBlock*& head : free_) {
+        while (head) {
+            FreeBlock* next = head->next;
+            free(head);
+            head = next;
+        }
+    }
+    // 比池更晚析构的thread_local对象（如其中的Buffer）归还块时直接free
+    poolDestroyed = true;
+}
+
+BlockPool& BlockPool::local_() {
+    thread_local BlockPool pool;
+    return pool;
+}
+
+size_t BlockPool::roundUp(size_t len) {
+    size_t cap = MIN_BLOCK;
+    while (cap < len && cap < MAX_BLOCK) {
+        cap *= 4;
+    }
+    if (cap < len) {
+        cap = (len + MIN_BLOCK - 1) / MIN_BLOCK * MIN_BLOCK;  // 超大块按4KB对齐，不缓存
+    }
+    return cap;
+}
+
+int BlockPool::classOf_(size_t cap) {
+    int cls = 0;
+    for (size_t size = MIN_BLOCK; size <= MAX_BLOCK; size *= 4, ++cls) {
+        if (size == cap) {
+            return cls;
+        }
+    }
+    return -1;
+}
+
+char* BlockPool::acquire(size_t len, size_t* cap) {
+    *cap = roundUp(len);
+    const int cls = classOf_(*cap);
+    if (cls >= 0 && !poolDestroyed) {
+        BlockPool& pool = local_();
+        if (FreeBlock* block = pool.free_[cls]) {
+            pool.free_[cls] = block->next;
+            --pool.freeCnt_[cls];
+            return reinterpret_cast<char*>(block);
+        }
+    }
+    void* block = malloc(*cap);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return static_cast<char*>(block);
+}
+
+void BlockPool::release(char* block, size_t cap) {
+    if (!block) {
+        return;
+    }
+    const int cls = classOf_(cap);
+    if (cls >= 0 && !poolDestroyed) {
+        BlockPool& pool = local_();
+        if (pool.freeCnt_[cls] * cap < MAX_CACHED_PER_CLASS) {
+            FreeBlock* node = reinterpret_cast<FreeBlock*>(block);
+            node->next = pool.free_[cls];
+            pool.free_[cls] = node;
+            ++pool.freeCnt_[cls];
+            return;
+        }
+    }
+    free(block);
+}
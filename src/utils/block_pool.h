@@ -0,0 +1,40 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <cstddef>
+
+// 每个线程一个的定长内存块池，供Buffer使用
+// 块按4KB起、每级×4分为若干尺寸级别，释放的块挂回当前线程对应级别的空闲链表
+// 块可以在一个线程取出、在另一个线程归还（线程池模式下很常见），归还到哪个线程就由哪个线程复用
+// 超过最大级别的请求直接malloc，不进入空闲链表
+class BlockPool {
+public:
+    static const size_t MIN_BLOCK = 4 * 1024;
+    static const size_t MAX_BLOCK = 1024 * 1024;
+
+    // 返回至少len字节的块，实际大小写入*cap，释放时必须原样传回
+    static char* acquire(size_t len, size_t* cap);
+    static void release(char* block, size_t cap);
+
+    // 按尺寸级别向上取整后的块大小
+    static size_t roundUp(size_t len);
+
+private:
+    static const int CLASS_COUNT = 5;                   // 4K 16K 64K 256K 1M
+    static const size_t MAX_CACHED_PER_CLASS = MAX_BLOCK;  // 每级空闲链表最多缓存的字节数
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    BlockPool() = default;
+    ~BlockPool();
+
+    static BlockPool& local_();
+    static int classOf_(size_t cap);
+
+    FreeBlock* free_[CLASS_COUNT] = {};
+    size_t freeCnt_[CLASS_COUNT] = {};
+};
+
+#endif  // BLOCK_POOL_H
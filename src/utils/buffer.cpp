@@ -1,13 +1,24 @@
 #include "buffer.h"
 #include <cerrno>
 
-Buffer::Buffer(int initBuffersize) : buffer_(initBuffersize), readPos_(0), writePos_(0) {}
+Buffer::Buffer(int initBuffersize) : buffer_(nullptr), capacity_(0), readPos_(0), writePos_(0) {
+    if (initBuffersize > 0) {
+        buffer_ = BlockPool::acquire(initBuffersize, &capacity_);
+    }
+}
+
+Buffer::~Buffer() {
+    BlockPool::release(buffer_, capacity_);
+}
 
 // 移动构造函数
 Buffer::Buffer(Buffer&& other) noexcept 
-    : buffer_(std::move(other.buffer_)), 
+    : buffer_(other.buffer_), 
+      capacity_(other.capacity_),
       readPos_(other.readPos_), 
       writePos_(other.writePos_) {
+    other.buffer_ = nullptr;
+    other.capacity_ = 0;
     other.readPos_ = 0;
     other.writePos_ = 0;
 }
@@ -15,9 +26,13 @@ Buffer::Buffer(Buffer&& other) noexcept
 // 移动赋值操作符
 Buffer& Buffer::operator=(Buffer&& other) noexcept {
     if (this != &other) {
-        buffer_ = std::move(other.buffer_);
+        BlockPool::release(buffer_, capacity_);
+        buffer_ = other.buffer_;
+        capacity_ = other.capacity_;
         readPos_ = other.readPos_;
         writePos_ = other.writePos_;
+        other.buffer_ = nullptr;
+        other.capacity_ = 0;
         other.readPos_ = 0;
         other.writePos_ = 0;
     }
@@ -29,7 +44,11 @@ size_t Buffer::readableBytes() const {
 }
 
 size_t Buffer::writeableBytes() const {
-    return buffer_.size() - writePos_;
+    return capacity_ - writePos_;
+}
+
+size_t Buffer::capacity() const {
+    return capacity_;
 }
 
 const char* Buffer::curReadPtr() const {
@@ -64,16 +83,50 @@ void Buffer::initPtr() {
     writePos_ = 0;
 }
 
+void Buffer::shrink() {
+    const size_t readable = readableBytes();
+    if (readable == 0) {
+        release();
+        return;
+    }
+    if (BlockPool::roundUp(readable) >= capacity_) {
+        return;
+    }
+    size_t cap = 0;
+    char* block = BlockPool::acquire(readable, &cap);
+    memcpy(block, curReadPtr(), readable);
+    BlockPool::release(buffer_, capacity_);
+    buffer_ = block;
+    capacity_ = cap;
+    readPos_ = 0;
+    writePos_ = readable;
+}
+
+void Buffer::release() {
+    BlockPool::release(buffer_, capacity_);
+    buffer_ = nullptr;
+    capacity_ = 0;
+    initPtr();
+}
+
 void Buffer::allocateSpace(size_t len) {
+    size_t readable = readableBytes();
     if (writeableBytes() + readPos_ < len) {
-        buffer_.resize(writePos_ + len + 1);
+        // 换一个能放下未读数据和len的块，未读数据搬到新块开头
+        size_t cap = 0;
+        char* block = BlockPool::acquire(readable + len, &cap);
+        if (readable > 0) {
+            memcpy(block, curReadPtr(), readable);
+        }
+        BlockPool::release(buffer_, capacity_);
+        buffer_ = block;
+        capacity_ = cap;
     } else {
-        size_t readable = readableBytes();
         std::copy(BeginPtr_() + readPos_, BeginPtr_() + writePos_, BeginPtr_());
-        readPos_ = 0;
-        writePos_ = readable;
-        assert(readable == readableBytes());
     }
+    readPos_ = 0;
+    writePos_ = readable;
+    assert(readable == readableBytes());
 }
 
 void Buffer::ensureWriteable(size_t len) {
@@ -116,6 +169,7 @@ void Buffer::append(Buffer&& buffer) {
     // 如果当前buffer为空，直接swap整个buffer
     if (readableBytes() == 0) {
         std::swap(buffer_, buffer.buffer_);
+        std::swap(capacity_, buffer.capacity_);
         readPos_ = buffer.readPos_;
         writePos_ = buffer.writePos_;
         buffer.initPtr();
@@ -130,6 +184,10 @@ void Buffer::append(Buffer&& buffer) {
 ssize_t Buffer::readFd(int fd, int* Errno) {
     // 使用thread_local缓冲区避免重复栈分配
     thread_local static char buff[65536];
+    // 空闲时块已归还，数据到达时先挂上一个最小块，普通请求直接读进块里
+    if (capacity_ == 0) {
+        ensureWriteable(BlockPool::MIN_BLOCK);
+    }
     struct iovec iov[2];
     const size_t writable = writeableBytes();
 
@@ -144,7 +202,7 @@ ssize_t Buffer::readFd(int fd, int* Errno) {
     } else if (static_cast<size_t>(len) <= writable) {
         writePos_ += len;
     } else {
-        writePos_ = buffer_.size();
+        writePos_ = capacity_;
         append(buff, len - writable);
     }
     return len;
@@ -172,9 +230,9 @@ std::string_view Buffer::view() const {
 }
 
 char* Buffer::BeginPtr_() {
-    return &*buffer_.begin();
+    return buffer_;
 }
 
 const char* Buffer::BeginPtr_() const {
-    return &*buffer_.begin();
+    return buffer_;
 }
\ No newline at end of file
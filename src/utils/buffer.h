@@ -5,15 +5,21 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include <charconv>
 #include <cstring>
 #include <string>
-#include <vector>
+#include <type_traits>
 #include <string_view>
 
+#include "block_pool.h"
+
+// 连续的读写缓冲区，存储是从当前线程BlockPool取得的定长块
+// 默认不预先分配，第一次写入时才取块；扩容时换成更大一级的块并把未读数据搬到块首
+// 连接在请求之间通过shrink/release归还块，空闲的keep-alive连接不占用缓冲区内存
 class Buffer {
 public:
-    Buffer(int initBufferSize = 8192);  // 提升到8KB避免早期重新分配
-    ~Buffer() = default;
+    Buffer(int initBufferSize = 0);
+    ~Buffer();
     
     // 移动构造和移动赋值
     Buffer(Buffer&& other) noexcept;
@@ -33,6 +39,12 @@ public:
     void updateReadPtrUntilEnd(const char* end);
     void updateWritePtr(size_t len);
     void initPtr();
+    size_t capacity() const;
+
+    // 连接空闲时调用：没有未读数据时把块还给线程的块池，否则换成放得下未读数据的最小一级块
+    void shrink();
+    // 丢弃全部数据并归还块
+    void release();
 
     void ensureWriteable(size_t len);
     void append(const char* str, size_t len);
@@ -42,6 +54,17 @@ public:
     void append(const void* data, size_t len);
     void append(Buffer&& buffer);  // 移动语义版本
 
+    // 格式化追加：参数可以是整数或任何能转换为string_view的类型，按顺序拼接
+    // 先按上界一次预留空间，再直接写入可写区，整数用to_chars转换，不产生临时字符串
+    // 注意char和bool也按整数输出
+    template <typename... Parts>
+    void appendAll(const Parts&... parts) {
+        ensureWriteable((partBound_(parts) + ... + 0));
+        char* p = curWritePtr();
+        ((p = writePart_(p, parts)), ...);
+        updateWritePtr(p - curWritePtr());
+    }
+
     ssize_t readFd(int fd, int* Errno);
     ssize_t writeFd(int fd, int* Errno);
 
@@ -49,11 +72,34 @@ public:
     std::string_view view() const;  // 获取string_view避免拷贝
 
 private:
+    template <typename T>
+    static size_t partBound_(const T& part) {
+        if constexpr (std::is_integral_v<T>) {
+            return 20;  // 64位整数的最大十进制位数（含负号）
+        } else {
+            return std::string_view(part).size();
+        }
+    }
+
+    template <typename T>
+    static char* writePart_(char* p, const T& part) {
+        if constexpr (std::is_integral_v<T>) {
+            return std::to_chars(p, p + 20, part).ptr;
+        } else {
+            std::string_view s(part);
+            if (!s.empty()) {
+                memcpy(p, s.data(), s.size());
+            }
+            return p + s.size();
+        }
+    }
+
     char* BeginPtr_();
     const char* BeginPtr_() const;
     void allocateSpace(size_t len);
 
-    std::vector<char> buffer_;
+    char* buffer_;
+    size_t capacity_;
     size_t readPos_;   // 改为普通size_t，提升性能
     size_t writePos_;  // 改为普通size_t，提升性能
 };
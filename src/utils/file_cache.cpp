@@ -0,0 +1,325 @@
+#include "file_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <functional>
+#include <iostream>
+
+CachedFile::CachedFile() {
+    for (auto& p : prebuilt_) {
+        p.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+CachedFile::~CachedFile() {
+    for (auto& p : prebuilt_) {
+        delete p.load(std::memory_order_relaxed);
+    }
+    if (data) {
+        munmap(data, size);
+    }
+}
+
+const PrebuiltResponse* CachedFile::findPrebuilt(int code, bool keepAlive, bool encoded) const {
+    const PrebuiltResponse* resp = prebuilt_[slot_(code, keepAlive)].load(std::memory_order_acquire);
+    return resp && resp->code == code && resp->encoded == encoded ? resp : nullptr;
+}
+
+const PrebuiltResponse* CachedFile::publishPrebuilt(std::unique_ptr<PrebuiltResponse> resp) const {
+    std::atomic<PrebuiltResponse*>& slot = prebuilt_[slot_(resp->code, resp->keepAlive)];
+    PrebuiltResponse* expected = nullptr;
+    if (slot.compare_exchange_strong(expected, resp.get(), std::memory_order_acq_rel)) {
+        return resp.release();
+    }
+    return expected->code == resp->code && expected->encoded == resp->encoded ? expected : nullptr;
+}
+
+std::string CachedFile::makeETag(const struct stat& st) {
+    char buf[64];
+    unsigned long long mtime = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    int len = snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx\"", static_cast<unsigned long long>(st.st_ino),
+                       static_cast<unsigned long long>(st.st_size), mtime);
+    return std::string(buf, len);
+}
+
+std::string CachedFile::makeHttpDate(time_t t) {
+    struct tm tm;
+    char buf[64];
+    gmtime_r(&t, &tm);
+    size_t len = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, len);
+}
+
+FileCache::~FileCache() {
+    stop();
+}
+
+void FileCache::start(const std::vector<std::string>& roots) {
+    if (running_.exchange(true)) {
+        return;
+    }
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ < 0) {
+        std::cout << "inotify unavailable, file cache disabled" << std::endl;
+        running_.store(false);
+        return;
+    }
+    for (const std::string& root : roots) {
+        std::string dir = root;
+        while (dir.size() > 1 && dir.back() == '/') {
+            dir.pop_back();
+        }
+        addWatch_(dir);
+    }
+    enabled_.store(true, std::memory_order_release);
+    watchThread_ = std::thread([this]() { watchLoop_(); });
+}
+
+void FileCache::stop() {
+    enabled_.store(false, std::memory_order_release);
+    running_.store(false, std::memory_order_release);
+    if (watchThread_.joinable()) {
+        watchThread_.join();
+    }
+    if (inotifyFd_ >= 0) {
+        close(inotifyFd_);
+        inotifyFd_ = -1;
+    }
+    watchDirs_.clear();
+    invalidate(std::string_view());
+}
+
+FileCache::Shard& FileCache::shardFor_(const std::string& path) {
+    return shards_[std::hash<std::string>()(path) % SHARD_COUNT];
+}
+
+bool FileCache::normalize_(const std::string& path, std::string* out) {
+    // 合并重复的'/'并去掉"."段，保证与inotify事件拼出的路径一致；含".."的路径不进缓存
+    out->clear();
+    out->reserve(path.size());
+    size_t i = 0;
+    while (i < path.size()) {
+        if (path[i] != '/') {
+            out->push_back(path[i++]);
+            continue;
+        }
+        while (i < path.size() && path[i] == '/') {
+            ++i;
+        }
+        size_t next = path.find('/', i);
+        std::string_view seg(path.data() + i, (next == std::string::npos ? path.size() : next) - i);
+        if (seg == ".") {
+            i += 1;
+            continue;
+        }
+        if (seg == "..") {
+            return false;
+        }
+        out->push_back('/');
+    }
+    return true;
+}
+
+std::shared_ptr<const CachedFile> FileCache::find(const std::string& rawPath) {
+    thread_local std::string path;
+    if (!enabled_.load(std::memory_order_acquire) || !normalize_(rawPath, &path)) {
+        return nullptr;
+    }
+    std::shared_ptr<const CachedFile> file;
+    int err = 0;
+    uint64_t gen = 0;
+    lookup_(shardFor_(path), path, &file, &err, &gen);
+    return file;
+}
+
+bool FileCache::lookup_(Shard& shard, const std::string& path,
+                        std::shared_ptr<const CachedFile>* file, int* err, uint64_t* gen) {
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    *gen = shard.generation;
+    auto it = shard.map.find(path);
+    if (it == shard.map.end()) {
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+    *file = it->second.file;
+    *err = it->second.err;
+    return true;
+}
+
+std::shared_ptr<const CachedFile> FileCache::get(const std::string& rawPath, int* err, bool cacheMissing) {
+    thread_local std::string path;
+    if (!enabled_.load(std::memory_order_acquire) || !normalize_(rawPath, &path)) {
+        return open_(rawPath, err);
+    }
+
+    Shard& shard = shardFor_(path);
+    std::shared_ptr<const CachedFile> file;
+    uint64_t gen = 0;
+    if (lookup_(shard, path, &file, err, &gen)) {
+        return file;
+    }
+
+    // 打开和映射在锁外进行，并发未命中时可能重复打开，以后插入的为准
+    // 压缩副本不存在的结果也缓存：文件被创建时inotify会删除这个条目
+    // 打开期间文件被修改或创建时，invalidate找不到条目可删，由generation的变化发现，本次结果不插入
+    file = open_(path, err);
+    if ((file && Shard::Entry::bytesOf(file) <= MAX_BYTES_PER_SHARD / 4) || (!file && *err == ENOENT && cacheMissing)) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        if (shard.generation == gen) {
+            insert_(shard, path, file, file ? 0 : *err);
+        }
+    }
+    return file;
+}
+
+void FileCache::insert_(Shard& shard, const std::string& path,
+                        const std::shared_ptr<const CachedFile>& file, int err) {
+    const size_t bytes = Shard::Entry::bytesOf(file);
+    auto it = shard.map.find(path);
+    if (it != shard.map.end()) {
+        shard.bytes -= it->second.bytes();
+        shard.lru.erase(it->second.lru);
+        shard.map.erase(it);
+    }
+    // 按条目数和映射字节数淘汰最久未使用的条目
+    while (!shard.lru.empty() &&
+           (shard.map.size() >= MAX_ENTRIES_PER_SHARD || shard.bytes + bytes > MAX_BYTES_PER_SHARD)) {
+        auto victim = shard.map.find(shard.lru.back());
+        shard.bytes -= victim->second.bytes();
+        shard.map.erase(victim);
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(path);
+    shard.map.emplace(path, Shard::Entry{file, err, shard.lru.begin()});
+    shard.bytes += bytes;
+}
+
+void FileCache::invalidate(std::string_view path) {
+    if (path.empty()) {
+        for (Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            shard.map.clear();
+            shard.lru.clear();
+            shard.bytes = 0;
+            ++shard.generation;
+        }
+        return;
+    }
+    std::string key(path);
+    Shard& shard = shardFor_(key);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    ++shard.generation;
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        shard.bytes -= it->second.bytes();
+        shard.lru.erase(it->second.lru);
+        shard.map.erase(it);
+    }
+}
+
+std::shared_ptr<const CachedFile> FileCache::open_(const std::string& path, int* err) const {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *err = errno;
+        return nullptr;
+    }
+    auto file = std::make_shared<CachedFile>();
+    file->fd.reset(fd);
+    if (fstat(fd, &file->st) < 0) {
+        *err = errno;
+        return nullptr;
+    }
+    if (!S_ISREG(file->st.st_mode)) {
+        *err = S_ISDIR(file->st.st_mode) ? EISDIR : EACCES;
+        return nullptr;
+    }
+    file->size = file->st.st_size;
+    file->etag = CachedFile::makeETag(file->st);
+    file->lastModified = CachedFile::makeHttpDate(file->st.st_mtime);
+    if (file->size > 0 && file->size <= mmapLimit_) {
+        void* data = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            *err = errno;
+            return nullptr;
+        }
+        file->data = static_cast<char*>(data);
+    }
+    return file;
+}
+
+void FileCache::addWatch_(const std::string& dir) {
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                          IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    int wd = inotify_add_watch(inotifyFd_, dir.c_str(), mask | IN_ONLYDIR);
+    if (wd < 0) {
+        return;
+    }
+    watchDirs_[wd] = dir;
+
+    // inotify不递归，子目录逐个添加
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    while (struct dirent* ent = readdir(d)) {
+        if (ent->d_type == DT_DIR && strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+            addWatch_(dir + "/" + ent->d_name);
+        }
+    }
+    closedir(d);
+}
+
+void FileCache::watchLoop_() {
+    alignas(struct inotify_event) char buf[4096];
+    while (running_.load(std::memory_order_acquire)) {
+        // 周期性醒来检查退出标志，与DateCache的后台线程一致
+        struct pollfd pfd = {inotifyFd_, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+        ssize_t len = read(inotifyFd_, buf, sizeof(buf));
+        if (len <= 0) {
+            continue;
+        }
+        for (char* p = buf; p < buf + len;) {
+            auto* ev = reinterpret_cast<struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                invalidate(std::string_view());  // 丢失了事件，无法确定哪些文件变化
+                continue;
+            }
+            auto it = watchDirs_.find(ev->wd);
+            if (it == watchDirs_.end()) {
+                continue;
+            }
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                watchDirs_.erase(it);
+                invalidate(std::string_view());
+                continue;
+            }
+            if (ev->len == 0) {
+                continue;
+            }
+            std::string path = it->second + "/" + ev->name;
+            if (ev->mask & IN_ISDIR) {
+                // 目录被移入或新建时开始监听；其下的条目（包括负缓存）无法逐个定位，全部清空
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    addWatch_(path);
+                }
+                invalidate(std::string_view());
+                continue;
+            }
+            invalidate(path);
+        }
+    }
+}
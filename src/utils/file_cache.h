@@ -0,0 +1,158 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "unique_fd.h"
+
+// 小文件的完整响应（状态行、响应头和文件内容），只缺Date头
+// block[0, headLen)是Date之前的部分，block[headLen, end)是Date之后的部分
+struct PrebuiltResponse {
+    int code;
+    bool keepAlive;
+    bool encoded;  // 作为协商出的压缩副本发送（带Content-Encoding），而不是被直接请求
+    size_t headLen;
+    std::string block;
+};
+
+// 一个已打开的静态文件：fd、stat结果和只读映射，由shared_ptr在连接之间共享
+// 最后一个引用释放时才munmap/close，缓存失效不会影响正在发送的响应
+struct CachedFile {
+    CachedFile();
+    ~CachedFile();
+
+    CachedFile(const CachedFile&) = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+
+    // 预构建响应按(keepAlive, 是否为200)分4个槽位，首次使用时构建后发布
+    const PrebuiltResponse* findPrebuilt(int code, bool keepAlive, bool encoded) const;
+    // 并发构建时以先发布者为准；槽位已被其他状态码或发送方式占用时返回nullptr
+    const PrebuiltResponse* publishPrebuilt(std::unique_ptr<PrebuiltResponse> resp) const;
+
+    // 由stat结果生成的校验值，打开时计算一次，条件请求未命中缓存时也用它们只做stat比较
+    static std::string makeETag(const struct stat& st);
+    static std::string makeHttpDate(time_t t);
+
+    unique_fd fd;
+    struct stat st = {};
+    std::string etag;          // "inode-size-mtime"，带引号
+    std::string lastModified;  // IMF-fixdate格式的st_mtime
+    char* data = nullptr;  // 空文件或超过映射上限的文件为nullptr，后者由调用方用fd发送
+    size_t size = 0;
+
+private:
+    static int slot_(int code, bool keepAlive) {
+        return (keepAlive ? 2 : 0) + (code == 200 ? 0 : 1);
+    }
+
+    mutable std::atomic<PrebuiltResponse*> prebuilt_[4];
+};
+
+// 分片的有界打开文件缓存，键为完整路径
+// 后台线程通过inotify监听资源目录，文件变化时删除对应条目；inotify不可用时不缓存
+// 预压缩副本不存在的结果也会缓存（负缓存），副本的查找因此在稳定后没有系统调用；
+// 其余不存在的路径不缓存，随机的404请求不会挤掉热点文件
+class FileCache {
+public:
+    static FileCache& getInstance() {
+        static FileCache instance;
+        return instance;
+    }
+
+    // 监听roots中的目录（含子目录）并启用缓存
+    void start(const std::vector<std::string>& roots);
+    void stop();
+
+    // 打开并映射普通文件，失败时返回nullptr并把原因写入*err（errno值）
+    // cacheMissing为true时ENOENT也会被缓存，只用于探测已存在文件的压缩副本，条目数随资源文件数有界
+    std::shared_ptr<const CachedFile> get(const std::string& path, int* err, bool cacheMissing = false);
+
+    // 只查缓存，不打开文件，未命中、负缓存或缓存未启用时返回nullptr
+    std::shared_ptr<const CachedFile> find(const std::string& path);
+
+    // 删除一个路径对应的条目，path为空时清空全部
+    void invalidate(std::string_view path);
+
+    // 大于limit的文件只打开不映射，须在处理请求之前设置
+    void setMmapLimit(size_t limit) {
+        mmapLimit_ = limit;
+    }
+
+private:
+    FileCache() = default;
+    ~FileCache();
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    static const size_t SHARD_COUNT = 16;
+    static const size_t MAX_ENTRIES_PER_SHARD = 64;
+    static const size_t MAX_BYTES_PER_SHARD = 64 * 1024 * 1024;
+
+    // 每个分片一把锁，LRU链表头部为最近使用
+    struct Shard {
+        using LruList = std::list<std::string>;
+        // file为空时是负缓存条目，err是打开失败的原因
+        struct Entry {
+            std::shared_ptr<const CachedFile> file;
+            int err;
+            LruList::iterator lru;
+
+            // 只计映射进内存的字节，超过映射上限、只持有fd的文件不占分片的字节预算
+            static size_t bytesOf(const std::shared_ptr<const CachedFile>& file) {
+                return file && file->data ? file->size : 0;
+            }
+            size_t bytes() const {
+                return bytesOf(file);
+            }
+        };
+
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> map;
+        LruList lru;
+        size_t bytes = 0;
+        // 每次invalidate加一：未命中后在锁外打开文件期间分片内有路径变化时，打开的结果可能已过时，不再插入
+        uint64_t generation = 0;
+    };
+
+    Shard& shardFor_(const std::string& path);
+    static bool normalize_(const std::string& path, std::string* out);
+    // 命中时返回true，负缓存条目的file为空、*err为缓存的原因；*gen为同一次加锁时分片的generation
+    bool lookup_(Shard& shard, const std::string& path, std::shared_ptr<const CachedFile>* file, int* err,
+                 uint64_t* gen);
+    std::shared_ptr<const CachedFile> open_(const std::string& path, int* err) const;
+    void insert_(Shard& shard, const std::string& path, const std::shared_ptr<const CachedFile>& file, int err);
+
+    void watchLoop_();
+    void addWatch_(const std::string& dir);
+
+    Shard shards_[SHARD_COUNT];
+
+    size_t mmapLimit_ = SIZE_MAX;
+    std::atomic<bool> enabled_{false};
+    std::atomic<bool> running_{false};
+    int inotifyFd_ = -1;
+    std::unordered_map<int, std::string> watchDirs_;  // 只在监听线程中访问
+    std::thread watchThread_;
+};
+
+inline void startFileCache(const std::vector<std::string>& roots) {
+    FileCache::getInstance().start(roots);
+}
+
+inline void stopFileCache() {
+    FileCache::getInstance().stop();
+}
+
+#endif  // FILE_CACHE_H
@@ -0,0 +1,240 @@
+#include "precompress.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "unique_fd.h"
+
+namespace {
+
+// 压缩后至少要比原文件小这么多（百分比）才值得保存
+const size_t MIN_SAVING_PERCENT = 10;
+// 太小的文件压缩收益抵不过一次协商
+const size_t MIN_ASSET_SIZE = 256;
+
+bool readFile(const std::string& path, std::string* out) {
+    unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd.get(), &st) < 0) {
+        return false;
+    }
+    out->resize(st.st_size);
+    size_t off = 0;
+    while (off < out->size()) {
+        ssize_t n = read(fd.get(), &(*out)[off], out->size() - off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        off += n;
+    }
+    return true;
+}
+
+// 先写临时文件再rename，正在运行的进程不会读到写了一半的副本
+bool writeFile(const std::string& path, const std::string& data) {
+    std::string tmp = path + ".tmp";
+    unique_fd fd(open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (fd.get() < 0) {
+        return false;
+    }
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = write(fd.get(), data.data() + off, data.size() - off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            unlink(tmp.c_str());
+            return false;
+        }
+        off += n;
+    }
+    fd.close();
+    if (rename(tmp.c_str(), path.c_str()) < 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool makeDirs(const std::string& dir) {
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+        std::string sub = dir.substr(0, pos);
+        if (mkdir(sub.c_str(), 0755) < 0 && errno != EEXIST) {
+            return false;
+        }
+        if (pos == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+#ifdef HAVE_ZLIB
+bool gzipCompress(const std::string& in, std::string* out) {
+    z_stream zs = {};
+    // windowBits加16输出gzip格式而不是zlib格式
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out->resize(deflateBound(&zs, in.size()) + 32);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&(*out)[0]);
+    zs.avail_out = out->size();
+    int ret = deflate(&zs, Z_FINISH);
+    out->resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+#endif
+
+#ifdef HAVE_BROTLI
+bool brotliCompress(const std::string& in, std::string* out) {
+    size_t len = BrotliEncoderMaxCompressedSize(in.size());
+    out->resize(len);
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, in.size(),
+                               reinterpret_cast<const uint8_t*>(in.data()), &len,
+                               reinterpret_cast<uint8_t*>(&(*out)[0]))) {
+        return false;
+    }
+    out->resize(len);
+    return true;
+}
+#endif
+
+struct Encoder {
+    const char* ext;
+    bool (*compress)(const std::string& in, std::string* out);
+};
+
+const Encoder ENCODERS[] = {
+#ifdef HAVE_ZLIB
+    {".gz", gzipCompress},
+#endif
+#ifdef HAVE_BROTLI
+    {".br", brotliCompress},
+#endif
+    {nullptr, nullptr},
+};
+
+int precompressFile(const std::string& src, const struct stat& srcSt, const std::string& dstBase) {
+    std::string content;
+    bool loaded = false;
+    int count = 0;
+    for (const Encoder* enc = ENCODERS; enc->ext; ++enc) {
+        std::string dst = dstBase + enc->ext;
+        struct stat dstSt;
+        if (stat(dst.c_str(), &dstSt) == 0 && dstSt.st_mtime >= srcSt.st_mtime) {
+            continue;  // 副本已是最新
+        }
+        if (!loaded) {
+            if (!readFile(src, &content)) {
+                return count;
+            }
+            loaded = true;
+        }
+        std::string out;
+        if (!enc->compress(content, &out) || out.size() * 100 > content.size() * (100 - MIN_SAVING_PERCENT)) {
+            unlink(dst.c_str());  // 删除可能存在的过期副本
+            continue;
+        }
+        if (writeFile(dst, out)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+int precompressDir(const std::string& srcDir, const std::string& dstDir) {
+    DIR* d = opendir(srcDir.c_str());
+    if (!d) {
+        return 0;
+    }
+    int count = 0;
+    bool dstReady = false;
+    while (struct dirent* ent = readdir(d)) {
+        if (ent->d_name[0] == '.') {
+            continue;  // 跳过"."、".."和隐藏文件
+        }
+        std::string src = srcDir + "/" + ent->d_name;
+        std::string dst = dstDir + "/" + ent->d_name;
+        struct stat st;
+        if (stat(src.c_str(), &st) < 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            count += precompressDir(src, dst);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) < MIN_ASSET_SIZE ||
+            !isCompressibleAsset(ent->d_name)) {
+            continue;
+        }
+        if (!dstReady && !(dstReady = makeDirs(dstDir))) {
+            std::cout << "precompress: cannot create " << dstDir << std::endl;
+            break;
+        }
+        count += precompressFile(src, st, dst);
+    }
+    closedir(d);
+    return count;
+}
+
+}  // namespace
+
+bool isCompressibleAsset(std::string_view path) {
+    static const std::string_view EXTS[] = {".html", ".htm", ".css", ".js", ".txt", ".xml", ".svg", ".json"};
+    size_t dot = path.find_last_of("./");
+    if (dot == std::string_view::npos || path[dot] != '.') {
+        return false;
+    }
+    // 扩展名不区分大小写，与MIME类型查找一致，转成小写放在栈上比较
+    std::string_view ext = path.substr(dot);
+    char lower[8];
+    if (ext.size() > sizeof(lower)) {
+        return false;
+    }
+    for (size_t i = 0; i < ext.size(); ++i) {
+        char c = ext[i];
+        lower[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    std::string_view key(lower, ext.size());
+    for (std::string_view e : EXTS) {
+        if (key == e) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int precompressAssets(const std::string& srcDir, const std::string& cacheDir) {
+    if (!ENCODERS[0].ext) {
+        return -1;
+    }
+    auto trim = [](std::string dir) {
+        while (dir.size() > 1 && dir.back() == '/') {
+            dir.pop_back();
+        }
+        return dir;
+    };
+    return precompressDir(trim(srcDir), trim(cacheDir));
+}
@@ -0,0 +1,15 @@
+#ifndef PRECOMPRESS_H
+#define PRECOMPRESS_H
+
+#include <string>
+#include <string_view>
+
+// 按扩展名判断是否是值得压缩的文本资源（html/css/js/txt/xml/svg/json）
+bool isCompressibleAsset(std::string_view path);
+
+// 启动时把srcDir下的文本资源预压缩到cacheDir，目录结构与srcDir一致，生成name.gz和name.br
+// 已有副本比源文件新时跳过；压缩后没有明显变小的文件不生成副本
+// 返回本次生成的文件数，zlib和brotli都不可用时返回-1
+int precompressAssets(const std::string& srcDir, const std::string& cacheDir);
+
+#endif  // PRECOMPRESS_H
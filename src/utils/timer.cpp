@@ -1,123 +1,181 @@
 #include "timer.h"
 
-void TimerManager::siftup_(size_t i) {
-    assert(i >= 0 && i < heap_.size());
-    while (i > 0) {
-        size_t j = (i - 1) / 2;
-        if (heap_[j] < heap_[i]) {
-            break;
+TimerManager::TimerManager(const TimeoutCallBack& cb)
+    : start_(Clock::now()), current_(0), count_(0), callback_(cb) {
+    for (auto& head : tv1_) {
+        head.prev = head.next = &head;
+    }
+    for (auto& level : tvn_) {
+        for (auto& head : level) {
+            head.prev = head.next = &head;
         }
-        swapNode_(i, j);
-        i = j;
     }
 }
 
-void TimerManager::swapNode_(size_t i, size_t j) {
-    assert(i >= 0 && i < heap_.size());
-    assert(j >= 0 && j < heap_.size());
-    std::swap(heap_[i], heap_[j]);
-    ref_[heap_[i].id] = i;
-    ref_[heap_[j].id] = j;
+uint64_t TimerManager::now_() const {
+    return std::chrono::duration_cast<MS>(Clock::now() - start_).count();
 }
 
-bool TimerManager::siftdown_(size_t index, size_t n) {
-    assert(index >= 0 && index < heap_.size());
-    assert(n >= 0 && n <= heap_.size());
-    size_t i = index;
-    size_t j = i * 2 + 1;
-    while (j < n) {
-        if (j + 1 < n && heap_[j + 1] < heap_[j])
-            j++;
-        if (heap_[i] < heap_[j])
-            break;
-        swapNode_(i, j);
-        i = j;
-        j = i * 2 + 1;
-    }
-    return i > index;
+void TimerManager::pushBack_(TimerNode* head, TimerNode* node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
 }
 
-void TimerManager::addTimer(int id, int timeout, const TimeoutCallBack& cb) {
-    assert(id >= 0);
-    size_t i;
-    if (ref_.count(id) == 0) {
-        i = heap_.size();
-        ref_[id] = i;
-        heap_.push_back({id, Clock::now() + MS(timeout), cb});
-        siftup_(i);
+void TimerManager::unlink_(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+void TimerManager::link_(TimerNode* node) {
+    // 已过期的节点放到当前桶，下一次tick立即处理
+    uint64_t expire = node->expire < current_ ? current_ : node->expire;
+    uint64_t idx = expire - current_;
+    TimerNode* head;
+    if (idx < TVR_SIZE) {
+        head = &tv1_[expire & TVR_MASK];
+    } else if (idx < (1ULL << (TVR_BITS + TVN_BITS))) {
+        head = &tvn_[0][(expire >> TVR_BITS) & TVN_MASK];
+    } else if (idx < (1ULL << (TVR_BITS + 2 * TVN_BITS))) {
+        head = &tvn_[1][(expire >> (TVR_BITS + TVN_BITS)) & TVN_MASK];
     } else {
-        i = ref_[id];
-        heap_[i].expire = Clock::now() + MS(timeout);
-        heap_[i].cb = cb;
-        if (!siftdown_(i, heap_.size())) {
-            siftup_(i);
+        if (idx > MAX_TIMEOUT) {
+            expire = current_ + MAX_TIMEOUT;
+            node->expire = expire;
         }
+        head = &tvn_[2][(expire >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK];
+    }
+    pushBack_(head, node);
+}
+
+void TimerManager::addTimer(TimerNode* node, int id, int timeout) {
+    assert(node && id >= 0);
+    if (node->linked()) {
+        unlink_(node);
+        --count_;
     }
+    node->id = id;
+    node->expire = now_() + timeout;
+    link_(node);
+    ++count_;
 }
 
-void TimerManager::work(int id) {
-    if (heap_.empty() || ref_.count(id) == 0) {
+void TimerManager::update(TimerNode* node, int timeout) {
+    assert(node);
+    if (!node->linked()) {
+        return;
+    }
+    uint64_t expire = now_() + timeout;
+    if (expire >= node->expire) {
+        // 只推迟到期时刻，不移动节点
+        node->expire = expire;
         return;
     }
-    size_t i = ref_[id];
-    TimerNode node = heap_[i];
-    node.cb();
-    del_(i);
+    unlink_(node);
+    node->expire = expire;
+    link_(node);
 }
 
-void TimerManager::del_(size_t index) {
-    assert(!heap_.empty() && index >= 0 && index < heap_.size());
-    size_t i = index;
-    size_t n = heap_.size() - 1;
-    assert(i <= n);
-    if (i < n) {
-        swapNode_(i, n);
-        if (!siftdown_(i, n)) {
-            siftup_(i);
-        }
+void TimerManager::cancel(TimerNode* node) {
+    assert(node);
+    if (node->linked()) {
+        unlink_(node);
+        --count_;
     }
-    ref_.erase(heap_.back().id);
-    heap_.pop_back();
 }
 
-void TimerManager::update(int id, int timeout) {
-    assert(!heap_.empty() && ref_.count(id) > 0);
-    heap_[ref_[id]].expire = Clock::now() + MS(timeout);
-    siftdown_(ref_[id], heap_.size());
+void TimerManager::cascade_(TimerNode* bucket) {
+    // 把高层桶中的节点按到期时刻重新分配到低层
+    TimerNode list;
+    list.prev = list.next = &list;
+    if (bucket->next != bucket) {
+        list.next = bucket->next;
+        list.prev = bucket->prev;
+        list.next->prev = &list;
+        list.prev->next = &list;
+        bucket->prev = bucket->next = bucket;
+    }
+    while (list.next != &list) {
+        TimerNode* node = list.next;
+        unlink_(node);
+        link_(node);
+    }
 }
 
-void TimerManager::handle_expired_event() {
-    if (heap_.empty()) {
-        return;
+void TimerManager::tick_() {
+    const uint64_t index = current_ & TVR_MASK;
+    if (index == 0) {
+        for (int level = 0; level < 3; ++level) {
+            const uint64_t slot = (current_ >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK;
+            cascade_(&tvn_[level][slot]);
+            if (slot != 0) {
+                break;
+            }
+        }
     }
-    while (!heap_.empty()) {
-        TimerNode node = heap_.front();
-        if (std::chrono::duration_cast<MS>(node.expire - Clock::now()).count() > 0) {
-            break;
+
+    TimerNode* head = &tv1_[index];
+    while (head->next != head) {
+        TimerNode* node = head->next;
+        unlink_(node);
+        if (node->expire > current_) {
+            // 期间被刷新过，按新的到期时刻重新挂入
+            link_(node);
+            continue;
         }
-        node.cb();
-        pop();
+        --count_;
+        callback_(node->id);
     }
+    ++current_;
 }
 
-void TimerManager::pop() {
-    assert(!heap_.empty());
-    del_(0);
+void TimerManager::handle_expired_event() {
+    const uint64_t now = now_();
+    if (count_ == 0) {
+        current_ = now + 1;
+        return;
+    }
+    while (current_ <= now && count_ > 0) {
+        tick_();
+    }
+    if (count_ == 0 && current_ <= now) {
+        current_ = now + 1;
+    }
 }
 
 void TimerManager::clear() {
-    ref_.clear();
-    heap_.clear();
+    for (auto& head : tv1_) {
+        while (head.next != &head) {
+            unlink_(head.next);
+        }
+    }
+    for (auto& level : tvn_) {
+        for (auto& head : level) {
+            while (head.next != &head) {
+                unlink_(head.next);
+            }
+        }
+    }
+    count_ = 0;
 }
 
 int TimerManager::getNextHandle() {
     handle_expired_event();
-    size_t res = -1;
-    if (!heap_.empty()) {
-        res = std::chrono::duration_cast<MS>(heap_.front().expire - Clock::now()).count();
-        if (res < 0) {
-            res = 0;
+    if (count_ == 0) {
+        return -1;
+    }
+    // 在第一层找最近的非空桶；没有则最迟在下一次级联时醒来
+    const uint64_t now = now_();
+    const uint64_t boundary = (current_ | TVR_MASK) + 1;
+    uint64_t next = boundary;
+    for (uint64_t t = current_; t < boundary; ++t) {
+        TimerNode* head = &tv1_[t & TVR_MASK];
+        if (head->next != head) {
+            next = t;
+            break;
         }
     }
-    return res;
-}
\ No newline at end of file
+    return next > now ? static_cast<int>(next - now) : 0;
+}
@@ -1,59 +1,71 @@
 #ifndef TIMER_H
 #define TIMER_H
 
+#include <assert.h>
+#include <stdint.h>
+
 #include <chrono>
-#include <ctime>
-#include <deque>
 #include <functional>
-#include <memory>
-#include <queue>
-#include <unordered_map>
-
-#include "http_connection.h"
 
-typedef std::function<void()> TimeoutCallBack;
-typedef std::chrono::high_resolution_clock Clock;
+typedef std::function<void(int id)> TimeoutCallBack;
+typedef std::chrono::steady_clock Clock;
 typedef std::chrono::milliseconds MS;
 typedef Clock::time_point TimeStamp;
 
-class TimerNode {
-public:
-    int id;
-    TimeStamp expire;
-    TimeoutCallBack cb;
+// 侵入式定时器节点，嵌入在连接对象中，增删改都不需要分配内存
+struct TimerNode {
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t expire = 0;  // 到期时刻（毫秒tick）
+    int id = -1;
 
-    // 注意：operator< 为正序，配合heap算法实现最小堆（expire越小越优先）
-    bool operator<(const TimerNode& t) {
-        return expire < t.expire;
+    bool linked() const {
+        return next != nullptr;
     }
 };
 
+// 分层时间轮：1ms精度，4层（256 + 64 * 3个桶），覆盖约18.6小时
+// 添加/删除O(1)；刷新只改写到期时刻，节点留在原桶中，到桶时再按新时刻重新挂入
 class TimerManager {
 public:
-    TimerManager() {
-        heap_.reserve(64);
-    }
-    ~TimerManager() {
-        clear();
-    }
-    void addTimer(int id, int timeout, const TimeoutCallBack& cb);
+    explicit TimerManager(const TimeoutCallBack& cb);
+    ~TimerManager() = default;
+
+    TimerManager(const TimerManager&) = delete;
+    TimerManager& operator=(const TimerManager&) = delete;
+
+    void addTimer(TimerNode* node, int id, int timeout);
+    void update(TimerNode* node, int timeout);
+    void cancel(TimerNode* node);
+
     void handle_expired_event();
     int getNextHandle();
 
-    void update(int id, int timeout);
-    void work(int id);
-
-    void pop();
     void clear();
 
 private:
-    void del_(size_t i);
-    void siftup_(size_t i);
-    bool siftdown_(size_t index, size_t n);
-    void swapNode_(size_t i, size_t j);
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const uint64_t TVR_MASK = TVR_SIZE - 1;
+    static const uint64_t TVN_MASK = TVN_SIZE - 1;
+    static const uint64_t MAX_TIMEOUT = (1ULL << (TVR_BITS + 3 * TVN_BITS)) - 1;
+
+    uint64_t now_() const;
+    void link_(TimerNode* node);
+    static void unlink_(TimerNode* node);
+    static void pushBack_(TimerNode* head, TimerNode* node);
+    void cascade_(TimerNode* bucket);
+    void tick_();
+
+    TimeStamp start_;
+    uint64_t current_;  // 下一个要处理的tick
+    size_t count_;
+    TimeoutCallBack callback_;
 
-    std::vector<TimerNode> heap_;
-    std::unordered_map<int, size_t> ref_;
+    TimerNode tv1_[TVR_SIZE];
+    TimerNode tvn_[3][TVN_SIZE];
 };
 
-#endif  // TIMER_H
\ No newline at end of file
+#endif  // TIMER_H